@@ -0,0 +1,235 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define ANEG_COUNT   10
+#define ANEG_TIMEOUT 10000000000ULL
+
+struct aneg_bench {
+	struct loc bmcr;
+	struct loc bmsr;
+	uint16_t op;
+	uint64_t timeout;
+
+	uint64_t *aneg;
+	uint64_t *link;
+	int n;
+
+	uint64_t reads;
+	uint64_t read_ns;
+};
+
+static int aneg_cmp(const void *_a, const void *_b)
+{
+	const uint64_t *a = _a, *b = _b;
+
+	return (*a > *b) - (*a < *b);
+}
+
+/* BMSR is read back to back from the write on, so the time of each
+ * transition is known to within one read. Until the link has been seen
+ * down, which its latching guarantees however short the drop, the bits
+ * are still those of the previous round. */
+static int aneg_run(struct aneg_bench *b, int i)
+{
+	uint64_t start, now;
+	uint16_t bmcr, bmsr;
+	int err, down = 0;
+
+	err = mdio_read(&b->bmcr, &bmcr);
+	if (err)
+		return err;
+
+	if (b->op == BMCR_ANRESTART && !(bmcr & BMCR_ANENABLE)) {
+		fprintf(stderr, "error: aneg is disabled\n");
+		return -EINVAL;
+	}
+
+	/* clear any latched drop from before */
+	err = mdio_read(&b->bmsr, &bmsr);
+	if (err)
+		return err;
+
+	start = mono_ns();
+	err = mdio_write(&b->bmcr, bmcr | b->op);
+	if (err)
+		return err;
+
+	b->aneg[i] = 0;
+
+	for (;;) {
+		err = mdio_read(&b->bmsr, &bmsr);
+		if (err)
+			return err;
+
+		now = mono_ns();
+		b->reads++;
+
+		if (!(bmsr & BMSR_LSTATUS) || !(bmsr & BMSR_ANEGCOMPLETE))
+			down = 1;
+
+		if (down && !b->aneg[i] && (bmsr & BMSR_ANEGCOMPLETE))
+			b->aneg[i] = now - start;
+
+		if (down && (bmsr & BMSR_ANEGCOMPLETE) && (bmsr & BMSR_LSTATUS))
+			break;
+
+		if (now - start > b->timeout) {
+			fprintf(stderr, "error: no link after %.3fms%s\n",
+				(now - start) / 1e6, down ? "" :
+				", and it never went down");
+			return -ETIMEDOUT;
+		}
+	}
+
+	b->link[i] = now - start;
+	b->read_ns += now - start;
+	return 0;
+}
+
+static const char *aneg_speed(uint16_t bmcr)
+{
+	const struct reg_desc *rd = &reg_ieee.regs[MII_BMCR];
+	int i;
+
+	for (i = 0; i < rd->nfields; i++) {
+		if (!strcmp(rd->fields[i].name, "speed"))
+			return reg_field_enum(&rd->fields[i], bmcr) ? : "unknown";
+	}
+
+	return "unknown";
+}
+
+/* nearest rank, so that with fewer than 100 runs p99 is the worst */
+static uint64_t aneg_pct(const uint64_t *v, int n, int pct)
+{
+	return v[(n * pct + 99) / 100 - 1];
+}
+
+static void aneg_report(struct aneg_bench *b, const char *speed)
+{
+	const char *op = (b->op == BMCR_RESET) ? "reset" : "restart";
+	uint64_t *v[2] = { b->aneg, b->link };
+	char name[48];
+	int i;
+
+	qsort(b->aneg, b->n, sizeof(*b->aneg), aneg_cmp);
+	qsort(b->link, b->n, sizeof(*b->link), aneg_cmp);
+
+	if (emit_fmt != EMIT_TEXT) {
+		emit_begin();
+		emit_loc("loc", &b->bmcr);
+		emit_str("op", op);
+		emit_uint("runs", b->n);
+		emit_str("speed", speed);
+		emit_uint("aneg_min", b->aneg[0]);
+		emit_uint("aneg_p50", aneg_pct(b->aneg, b->n, 50));
+		emit_uint("aneg_p99", aneg_pct(b->aneg, b->n, 99));
+		emit_uint("aneg_max", b->aneg[b->n - 1]);
+		emit_uint("link_min", b->link[0]);
+		emit_uint("link_p50", aneg_pct(b->link, b->n, 50));
+		emit_uint("link_p99", aneg_pct(b->link, b->n, 99));
+		emit_uint("link_max", b->link[b->n - 1]);
+		emit_uint("read_ns", b->read_ns / b->reads);
+		emit_end();
+		return;
+	}
+
+	loc_str(&b->bmcr, name, sizeof(name));
+	printf("%s: %s x%d, speed:%s, one read every %.1fus\n", name, op,
+	       b->n, speed, b->read_ns / 1e3 / b->reads);
+
+	for (i = 0; i < 2; i++) {
+		printf("%*s%-14s min:%.3fms p50:%.3fms p99:%.3fms max:%.3fms\n",
+		       INDENT, "", i ? "link" : "aneg-complete", v[i][0] / 1e6,
+		       aneg_pct(v[i], b->n, 50) / 1e6,
+		       aneg_pct(v[i], b->n, 99) / 1e6, v[i][b->n - 1] / 1e6);
+	}
+}
+
+int phytool_aneg_bench(struct applet *a, int argc, char **argv)
+{
+	struct aneg_bench b = {
+		.op = BMCR_ANRESTART,
+		.timeout = ANEG_TIMEOUT,
+		.n = ANEG_COUNT,
+	};
+	uint16_t bmcr;
+	int err = 0, i;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-r")) {
+			b.op = BMCR_RESET;
+			argc--, argv++;
+			continue;
+		}
+
+		if (!strcmp(argv[0], "-n") && argc > 1) {
+			b.n = strtol(argv[1], NULL, 0);
+			if (b.n < 1)
+				return 1;
+		} else if (!strcmp(argv[0], "-t") && argc > 1) {
+			if (parse_interval(argv[1], &b.timeout))
+				return 1;
+		} else {
+			return 1;
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (argc != 1)
+		return 1;
+
+	if (a->parse_loc(argv[0], &b.bmcr, 0)) {
+		fprintf(stderr, "error: bad location format\n");
+		return 1;
+	}
+
+	b.bmcr.reg = MII_BMCR;
+	b.bmsr = b.bmcr;
+	b.bmsr.reg = MII_BMSR;
+
+	b.aneg = calloc(b.n, sizeof(*b.aneg));
+	b.link = calloc(b.n, sizeof(*b.link));
+	if (!b.aneg || !b.link) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; !err && i < b.n; i++)
+		err = aneg_run(&b, i);
+
+	err = err ? : mdio_read(&b.bmcr, &bmcr);
+	if (err)
+		goto out;
+
+	aneg_report(&b, aneg_speed(bmcr));
+out:
+	free(b.aneg);
+	free(b.link);
+	return err ? 1 : 0;
+}
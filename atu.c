@@ -0,0 +1,268 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* Give up on a unit that stays busy for this long */
+#define ATU_TIMEOUT 100000000ULL
+
+/* Every FID in turn, an empty one costs four transactions */
+#define ATU_FID_ALL -1
+
+struct atu_walk {
+	struct loc g1;
+	int fid;
+	int port;
+
+	uint64_t hold;
+	unsigned long entries;
+	unsigned long polls;
+};
+
+struct atu_ent {
+	uint16_t fid;
+	uint16_t data;
+	uint8_t mac[6];
+};
+
+static int atu_read_op(void *arg, uint16_t *val)
+{
+	struct atu_walk *w = arg;
+
+	return mdio_read(&w->g1, val);
+}
+
+/* Like the SMI unit, the first poll is held off for as long as the
+ * unit took last time, so a busy op is usually polled once. */
+static int atu_wait(struct atu_walk *w)
+{
+	struct poll p = {
+		.mask = ATU_BUSY,
+		.timeout = ATU_TIMEOUT,
+		.hold = &w->hold,
+	};
+	int err;
+
+	w->g1.reg = ATU_OP;
+	err = poll_wait(&p, atu_read_op, w, NULL);
+	w->polls += p.polls;
+	return err;
+}
+
+/* GetNext returns the entry following the MAC in the MAC registers of
+ * the FID, and leaves its MAC there, so every further entry only costs
+ * the op, its polls and reading the entry back. The end of the FID is
+ * an entry state of 0, with the MAC registers back at the broadcast
+ * address, which is where the next FID's walk starts from. */
+static int atu_next(struct atu_walk *w, struct atu_ent *ent)
+{
+	uint16_t mac[3];
+	int err, i;
+
+	w->g1.reg = ATU_OP;
+	err = mdio_write(&w->g1, ATU_BUSY | ATU_OP_GET_NEXT);
+	if (err)
+		return err;
+
+	err = atu_wait(w);
+	if (err)
+		return err;
+
+	w->g1.reg = ATU_DATA;
+	err = mdio_read(&w->g1, &ent->data);
+	if (err || !(ent->data & ATU_DATA_STATE))
+		return err;
+
+	w->g1.reg = ATU_MAC01;
+	err = mdio_read_range(&w->g1, mac, 3);
+	if (err)
+		return err;
+
+	for (i = 0; i < 3; i++) {
+		ent->mac[2 * i]     = mac[i] >> 8;
+		ent->mac[2 * i + 1] = mac[i] & 0xff;
+	}
+
+	return 1;
+}
+
+static const char *atu_state_str(const struct atu_ent *ent)
+{
+	static char str[16];
+	int state = ent->data & ATU_DATA_STATE;
+
+	/* unicast 1-7 count down as the entry ages */
+	if (!(ent->mac[0] & 1) && state < 8)
+		snprintf(str, sizeof(str), "age:%d", state);
+	else
+		snprintf(str, sizeof(str), "static:0x%x", state);
+
+	return str;
+}
+
+static void atu_print(const struct atu_ent *ent)
+{
+	unsigned vec = (ent->data & ATU_DATA_PORTVEC) >> 4;
+	char mac[18];
+	int first = 1, i;
+
+	snprintf(mac, sizeof(mac), "%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
+		 ent->mac[0], ent->mac[1], ent->mac[2],
+		 ent->mac[3], ent->mac[4], ent->mac[5]);
+
+	if (emit_fmt != EMIT_TEXT) {
+		emit_begin();
+		emit_uint("fid", ent->fid);
+		emit_str("mac", mac);
+		emit_uint("portvec", vec);
+		emit_bool("trunk", ent->data & ATU_DATA_TRUNK);
+		emit_str("state", atu_state_str(ent));
+		emit_end();
+		return;
+	}
+
+	printf("fid:%-4u mac:%s state:%-10s %s:", ent->fid, mac,
+	       atu_state_str(ent), (ent->data & ATU_DATA_TRUNK) ? "trunk" : "ports");
+
+	if (ent->data & ATU_DATA_TRUNK) {
+		printf("%u\n", vec & 0xf);
+		return;
+	}
+
+	for (i = 0; vec >> i; i++) {
+		if (!(vec & (1 << i)))
+			continue;
+
+		printf("%s%d", first ? "" : ",", i);
+		first = 0;
+	}
+
+	putchar('\n');
+}
+
+static int atu_match(const struct atu_walk *w, const struct atu_ent *ent)
+{
+	if (w->port < 0)
+		return 1;
+
+	return !(ent->data & ATU_DATA_TRUNK) &&
+		(ent->data & ATU_DATA_PORTVEC) & (1 << (w->port + 4));
+}
+
+/* Walk one FID, printing entries as they are read */
+static int atu_walk_fid(struct atu_walk *w, uint16_t fid)
+{
+	struct atu_ent ent = { .fid = fid };
+	int err;
+
+	w->g1.reg = ATU_FID;
+	err = mdio_write(&w->g1, fid);
+	if (err)
+		return err;
+
+	while ((err = atu_next(w, &ent)) > 0) {
+		w->entries++;
+
+		if (atu_match(w, &ent))
+			atu_print(&ent);
+
+		/* the broadcast address sorts last */
+		if (!memcmp(ent.mac, "\xff\xff\xff\xff\xff\xff", 6))
+			return 0;
+	}
+
+	return err;
+}
+
+/* Start every walk from the broadcast address, which sorts last, so
+ * that GetNext wraps to the first entry. */
+static int atu_start(struct atu_walk *w)
+{
+	int err = 0, reg;
+
+	for (reg = ATU_MAC01; !err && reg <= ATU_MAC45; reg++) {
+		w->g1.reg = reg;
+		err = mdio_write(&w->g1, 0xffff);
+	}
+
+	return err;
+}
+
+static int atu_dump(struct applet *a, int argc, char **argv)
+{
+	struct atu_walk w = { .fid = ATU_FID_ALL, .port = -1 };
+	uint64_t start;
+	char *end;
+	int err = 0, fid;
+
+	if (!argc)
+		return 1;
+
+	if (parse_switch_loc(a, argv[0], &w.g1, ATU_G1)) {
+		fprintf(stderr, "error: bad location format\n");
+		return 1;
+	}
+
+	for (argc--, argv++; argc >= 2; argc -= 2, argv += 2) {
+		if (!strcmp(argv[0], "fid"))
+			w.fid = strtoul(argv[1], &end, 0);
+		else if (!strcmp(argv[0], "port"))
+			w.port = strtoul(argv[1], &end, 0);
+		else
+			return 1;
+
+		if (*end || w.fid > ATU_FID_MAX || w.port > 10)
+			return 1;
+	}
+
+	if (argc)
+		return 1;
+
+	start = mono_ns();
+
+	err = atu_start(&w);
+	if (!err && w.fid != ATU_FID_ALL)
+		err = atu_walk_fid(&w, w.fid);
+
+	for (fid = 0; !err && w.fid == ATU_FID_ALL && fid <= ATU_FID_MAX; fid++)
+		err = atu_walk_fid(&w, fid);
+
+	if (err) {
+		fprintf(stderr, "error: atu (%d)\n", err);
+		return 1;
+	}
+
+	fprintf(stderr, "atu: %lu entries, %lu polls in %.1fms\n", w.entries,
+		w.polls, (mono_ns() - start) / 1e6);
+	return 0;
+}
+
+int mv6tool_atu(struct applet *a, int argc, char **argv)
+{
+	if (argc && !strcmp(argv[0], "dump"))
+		return atu_dump(a, argc - 1, &argv[1]);
+
+	return 1;
+}
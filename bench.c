@@ -0,0 +1,213 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define BENCH_COUNT 10000
+
+struct bench {
+	const char *text;
+	const char *op;
+	const struct loc *loc;
+
+	uint64_t *ns;
+	int n;
+};
+
+static int bench_cmp(const void *_a, const void *_b)
+{
+	const uint64_t *a = _a, *b = _b;
+
+	return (*a > *b) - (*a < *b);
+}
+
+static void bench_report(struct bench *b)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < b->n; i++)
+		total += b->ns[i];
+
+	qsort(b->ns, b->n, sizeof(*b->ns), bench_cmp);
+
+	printf("%-24s %-8s %-6s %-3s %10.0f %8llu %8llu %8llu\n",
+	       b->text, b->loc->ifnam, b->op, loc_is_c45(b->loc) ? "c45" : "c22",
+	       total ? (double)b->n * 1e9 / total : 0.0,
+	       (unsigned long long)b->ns[(b->n - 1) * 50 / 100],
+	       (unsigned long long)b->ns[(b->n - 1) * 99 / 100],
+	       (unsigned long long)b->ns[(b->n - 1) * 999 / 1000]);
+}
+
+static int bench_read(struct bench *b)
+{
+	uint64_t start;
+	uint16_t val;
+	int err, i;
+
+	for (i = 0; i < b->n; i++) {
+		start = mono_ns();
+		err = mdio_read(b->loc, &val);
+		b->ns[i] = mono_ns() - start;
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int bench_write(struct bench *b)
+{
+	uint64_t start;
+	uint16_t val;
+	int err, i;
+
+	/* write back what is there to leave the device as we found it */
+	err = mdio_read(b->loc, &val);
+	if (err)
+		return err;
+
+	for (i = 0; i < b->n; i++) {
+		start = mono_ns();
+		err = mdio_write(b->loc, val);
+		b->ns[i] = mono_ns() - start;
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static int bench_print(struct applet *a, struct bench *b)
+{
+	uint64_t start;
+	int err = 0, null, out, i;
+
+	/* keep the decoders' output off the terminal while timing them */
+	fflush(stdout);
+	out = dup(STDOUT_FILENO);
+	null = open("/dev/null", O_WRONLY);
+	if (out < 0 || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	for (i = 0; !err && i < b->n; i++) {
+		start = mono_ns();
+		err = a->print(b->loc, 0);
+		fflush(stdout);
+		b->ns[i] = mono_ns() - start;
+	}
+
+	dup2(out, STDOUT_FILENO);
+out:
+	if (null >= 0)
+		close(null);
+	if (out >= 0)
+		close(out);
+	return err;
+}
+
+int phytool_bench(struct applet *a, int argc, char **argv)
+{
+	struct bench b = { .n = BENCH_COUNT };
+	struct loc *locs = NULL;
+	int err = 0, wr = 0, i;
+	char *text;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-w")) {
+			wr = 1;
+		} else if (!strcmp(argv[0], "-n") && argc > 1) {
+			b.n = strtol(argv[1], NULL, 0);
+			argc--, argv++;
+		} else {
+			return 1;
+		}
+
+		argc--, argv++;
+	}
+
+	if (!argc || b.n <= 0)
+		return 1;
+
+	b.ns = calloc(b.n, sizeof(*b.ns));
+	locs = calloc(argc, sizeof(*locs));
+	if (!b.ns || !locs) {
+		err = 1;
+		goto out;
+	}
+
+	/* all of them, before any results are printed */
+	for (i = 0; i < argc; i++) {
+		text = strdup(argv[i]);
+		if (!text || a->parse_loc(text, &locs[i], 0)) {
+			fprintf(stderr, "error: bad location format\n");
+			free(text);
+			err = 1;
+			goto out;
+		}
+		free(text);
+	}
+
+	printf("%-24s %-8s %-6s %-3s %10s %8s %8s %8s\n", "LOCATION", "IFACE",
+	       "OP", "CL", "OPS/S", "P50(ns)", "P99(ns)", "P999(ns)");
+
+	for (i = 0; !err && i < argc; i++) {
+		b.text = argv[i];
+		b.loc = &locs[i];
+
+		if (b.loc->reg == REG_SUMMARY) {
+			b.op = "print";
+			err = bench_print(a, &b);
+			if (!err)
+				bench_report(&b);
+			continue;
+		}
+
+		b.op = "read";
+		err = bench_read(&b);
+		if (!err)
+			bench_report(&b);
+
+		if (err || !wr)
+			continue;
+
+		b.op = "write";
+		err = bench_write(&b);
+		if (!err)
+			bench_report(&b);
+	}
+
+	if (err)
+		fprintf(stderr, "error: bench %s %s failed (%d)\n", b.text, b.op,
+			err);
+out:
+	free(locs);
+	free(b.ns);
+	return err ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define CACHE_SIZE 512
+
+struct cache_ent {
+	struct loc loc;
+	uint16_t val;
+	int valid;
+};
+
+static struct cache_ent cache[CACHE_SIZE];
+static int cache_depth;
+
+/* Registers with self-clearing or latched bits, these must reach the
+ * bus on every read. For C45 that covers the MMD control/status pair,
+ * which on mv6 switches is the live port status register. */
+static const struct {
+	int c45;
+	uint16_t reg;
+} cache_volatile[] = {
+	{ 0, MII_BMCR },
+	{ 0, MII_BMSR },
+	{ 1, MDIO_CTRL1 },
+	{ 1, MDIO_STAT1 },
+};
+
+int phy_reg_volatile(const struct loc *loc)
+{
+	int c45 = !!loc_is_c45(loc);
+	size_t i;
+
+	for (i = 0; i < sizeof(cache_volatile) / sizeof(cache_volatile[0]); i++) {
+		if (cache_volatile[i].c45 == c45 && cache_volatile[i].reg == loc->reg)
+			return 1;
+	}
+
+	return 0;
+}
+
+static struct cache_ent *cache_slot(const struct loc *loc)
+{
+	const char *c;
+	unsigned h = 2166136261u;
+
+	for (c = loc->ifnam; *c && c < &loc->ifnam[IFNAMSIZ]; c++)
+		h = (h ^ *c) * 16777619u;
+
+	h = (h ^ loc->phy_id) * 16777619u;
+	h = (h ^ loc->reg) * 16777619u;
+	h = (h ^ loc->page) * 16777619u;
+	return &cache[h % CACHE_SIZE];
+}
+
+/* Scopes nest, e.g. print inside batch, the cache is dropped when the
+ * outermost one ends. */
+void phy_cache_begin(void)
+{
+	if (!cache_depth++)
+		phy_cache_flush();
+}
+
+void phy_cache_end(void)
+{
+	if (!--cache_depth)
+		phy_cache_flush();
+}
+
+void phy_cache_flush(void)
+{
+	memset(cache, 0, sizeof(cache));
+}
+
+int phy_cache_lookup(const struct loc *loc, uint16_t *val)
+{
+	struct cache_ent *ent;
+
+	if (!cache_depth || phy_reg_volatile(loc))
+		return -ENOENT;
+
+	ent = cache_slot(loc);
+	if (!ent->valid || !loc_eq(&ent->loc, loc))
+		return -ENOENT;
+
+	*val = ent->val;
+	return 0;
+}
+
+void phy_cache_store(const struct loc *loc, uint16_t val)
+{
+	struct cache_ent *ent;
+
+	if (!cache_depth || phy_reg_volatile(loc))
+		return;
+
+	/* direct mapped, a collision simply evicts the older entry */
+	ent = cache_slot(loc);
+	ent->loc = *loc;
+	ent->val = val;
+	ent->valid = 1;
+}
@@ -0,0 +1,595 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define PD_SOCKET "/run/phytoold.sock"
+#define PD_CACHE  256
+
+struct pd_ent {
+	struct loc loc;
+	uint16_t val;
+	int valid;
+
+	uint64_t stamp;
+	unsigned round;
+	const struct pd_line *line;
+};
+
+/* An interface, and the bus its transactions go to */
+struct pd_if {
+	struct pd_if *next;
+	struct pd_if *bus_next;
+	char ifnam[IFNAMSIZ];
+	struct pd_bus *bus;
+};
+
+/* One worker per MDIO bus owns all transactions on it, whichever of
+ * the interfaces on it they come in on. Requests queued up while it is
+ * busy are taken as one round, in which a register read by one request
+ * is handed to the others instead of read again. */
+struct pd_bus {
+	struct pd_bus *next;
+	char key[TOPO_BUS_LEN];
+
+	/* interfaces on it, only ever added to */
+	struct pd_if *ifs;
+
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct pd_sub *head;
+	struct pd_sub **tail;
+
+	unsigned round;
+	struct pd_ent cache[PD_CACHE];
+};
+
+struct pd_op {
+	struct pd_bus *bus;
+	struct loc loc;
+
+	int write;
+	uint16_t val;
+	int err;
+};
+
+/* A request line, done when every bus it touches has run its share */
+struct pd_line {
+	struct pd_op *ops;
+	int n;
+
+	int pending;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+};
+
+struct pd_sub {
+	struct pd_sub *next;
+	struct pd_line *line;
+	struct pd_bus *bus;
+};
+
+static struct {
+	struct applet *a;
+	uint64_t ttl;
+
+	pthread_mutex_t lock;
+	struct pd_bus *buses;
+	struct pd_if *ifs;
+
+	unsigned long lines;
+	unsigned long reads;
+	unsigned long xfers;
+
+	volatile sig_atomic_t stop;
+} pd = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct pd_ent *pd_slot(struct pd_bus *bus, const struct loc *loc)
+{
+	unsigned h = 2166136261u;
+
+	h = (h ^ loc->phy_id) * 16777619u;
+	h = (h ^ loc->reg) * 16777619u;
+	h = (h ^ loc->page) * 16777619u;
+	return &bus->cache[h % PD_CACHE];
+}
+
+static void pd_read(struct pd_bus *bus, const struct pd_line *line,
+		    struct pd_op *op, uint64_t now)
+{
+	struct pd_ent *ent = pd_slot(bus, &op->loc);
+
+	__atomic_fetch_add(&pd.reads, 1, __ATOMIC_RELAXED);
+
+	/* A line reading the same register twice, e.g. to get past a
+	 * latched bit, means it. Everyone else may share. */
+	if (ent->valid && loc_eq(&ent->loc, &op->loc) &&
+	    ((ent->round == bus->round && ent->line != line) ||
+	     (pd.ttl && now - ent->stamp < pd.ttl &&
+	      !phy_reg_volatile(&op->loc)))) {
+		op->val = ent->val;
+		op->err = 0;
+		return;
+	}
+
+	__atomic_fetch_add(&pd.xfers, 1, __ATOMIC_RELAXED);
+
+	op->err = mdio_read(&op->loc, &op->val);
+	if (op->err)
+		return;
+
+	ent->loc = op->loc;
+	ent->val = op->val;
+	ent->valid = 1;
+	ent->stamp = now;
+	ent->round = bus->round;
+	ent->line = line;
+}
+
+static void pd_write(struct pd_bus *bus, struct pd_op *op)
+{
+	__atomic_fetch_add(&pd.xfers, 1, __ATOMIC_RELAXED);
+
+	/* same as phy_write(), anything may have changed */
+	memset(bus->cache, 0, sizeof(bus->cache));
+
+	op->err = mdio_write(&op->loc, op->val);
+}
+
+static void pd_run(struct pd_bus *bus, struct pd_sub *sub)
+{
+	struct pd_line *line = sub->line;
+	uint64_t now = mono_ns();
+	int i;
+
+	for (i = 0; i < line->n; i++) {
+		if (line->ops[i].bus != bus)
+			continue;
+
+		if (line->ops[i].write)
+			pd_write(bus, &line->ops[i]);
+		else
+			pd_read(bus, line, &line->ops[i], now);
+	}
+
+	pthread_mutex_lock(&line->lock);
+	if (!--line->pending)
+		pthread_cond_signal(&line->done);
+	pthread_mutex_unlock(&line->lock);
+}
+
+static void *pd_worker(void *_bus)
+{
+	struct pd_bus *bus = _bus;
+	struct pd_sub *sub, *next;
+	struct pd_if *pi;
+
+	pthread_mutex_lock(&bus->lock);
+	for (;;) {
+		while (!bus->head)
+			pthread_cond_wait(&bus->cond, &bus->lock);
+
+		sub = bus->head;
+		bus->head = NULL;
+		bus->tail = &bus->head;
+		pthread_mutex_unlock(&bus->lock);
+
+		bus->round++;
+		for (; sub; sub = next) {
+			/* completing it may free it */
+			next = sub->next;
+			pd_run(bus, sub);
+		}
+
+		/* leave the PHYs on the pages the kernel had them on */
+		for (pi = __atomic_load_n(&bus->ifs, __ATOMIC_ACQUIRE); pi;
+		     pi = pi->bus_next)
+			mdio_restore(pi->ifnam);
+
+		pthread_mutex_lock(&bus->lock);
+	}
+
+	return NULL;
+}
+
+static int pd_iface_eq(const char *ifnam, void *arg)
+{
+	return !strncmp(ifnam, arg, IFNAMSIZ);
+}
+
+static struct pd_bus *pd_bus_start(const char *key)
+{
+	struct pd_bus *bus;
+
+	bus = calloc(1, sizeof(*bus));
+	if (!bus)
+		return NULL;
+
+	strcpy(bus->key, key);
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_cond_init(&bus->cond, NULL);
+	bus->tail = &bus->head;
+
+	if (pthread_create(&bus->tid, NULL, pd_worker, bus)) {
+		free(bus);
+		return NULL;
+	}
+
+	pthread_detach(bus->tid);
+	bus->next = pd.buses;
+	pd.buses = bus;
+	return bus;
+}
+
+/* Workers are started on first use, for interfaces that exist, and
+ * shared by all interfaces on the same MDIO bus (see topo_if_bus()),
+ * so that their paged accesses to a PHY are not interleaved either. */
+static struct pd_bus *pd_bus_get(const char *ifnam)
+{
+	char key[TOPO_BUS_LEN];
+	struct pd_bus *bus = NULL;
+	struct pd_if *pi;
+
+	pthread_mutex_lock(&pd.lock);
+
+	for (pi = pd.ifs; pi; pi = pi->next) {
+		if (!strncmp(pi->ifnam, ifnam, IFNAMSIZ)) {
+			bus = pi->bus;
+			goto out;
+		}
+	}
+
+	if (mdio_ifaces(pd_iface_eq, (void *)ifnam) != 1)
+		goto out;
+
+	topo_if_bus(ifnam, key, sizeof(key));
+
+	for (bus = pd.buses; bus; bus = bus->next) {
+		if (!strcmp(bus->key, key))
+			break;
+	}
+
+	pi = calloc(1, sizeof(*pi));
+	if (!pi) {
+		bus = NULL;
+		goto out;
+	}
+
+	if (!bus)
+		bus = pd_bus_start(key);
+	if (!bus) {
+		free(pi);
+		goto out;
+	}
+
+	strncpy(pi->ifnam, ifnam, IFNAMSIZ - 1);
+	pi->bus = bus;
+	pi->next = pd.ifs;
+	pd.ifs = pi;
+
+	/* the worker walks these without the lock */
+	pi->bus_next = bus->ifs;
+	__atomic_store_n(&bus->ifs, pi, __ATOMIC_RELEASE);
+out:
+	pthread_mutex_unlock(&pd.lock);
+	return bus;
+}
+
+static int pd_add(struct pd_line *line, const struct loc *loc, int write,
+		  uint16_t val)
+{
+	struct pd_op *ops;
+
+	ops = realloc(line->ops, (line->n + 1) * sizeof(*ops));
+	if (!ops)
+		return -ENOMEM;
+
+	line->ops = ops;
+	memset(&ops[line->n], 0, sizeof(*ops));
+	ops[line->n].loc = *loc;
+	ops[line->n].write = write;
+	ops[line->n].val = val;
+	line->n++;
+	return 0;
+}
+
+/* read LOC[-END]... | write LOC VAL... [; ...] */
+static int pd_parse(struct pd_line *line, char *text)
+{
+	char *cmd, *tok, *save_cmd, *save;
+	unsigned long val;
+	struct loc loc;
+	int count, err, i, write;
+
+	for (cmd = strtok_r(text, ";\n", &save_cmd); cmd;
+	     cmd = strtok_r(NULL, ";\n", &save_cmd)) {
+		tok = strtok_r(cmd, " \t", &save);
+		if (!tok)
+			continue;
+
+		if (!strcmp(tok, "read"))
+			write = 0;
+		else if (!strcmp(tok, "write"))
+			write = 1;
+		else
+			return -EINVAL;
+
+		while ((tok = strtok_r(NULL, " \t", &save))) {
+			if (parse_loc_range(pd.a, tok, &loc, &count, 1))
+				return -EINVAL;
+
+			val = 0;
+			if (write) {
+				tok = strtok_r(NULL, " \t", &save);
+				if (!tok || count != 1)
+					return -EINVAL;
+
+				val = strtoul(tok, &tok, 0);
+				if (*tok || val > 0xffff)
+					return -EINVAL;
+			}
+
+			for (i = 0; i < count; i++, loc.reg++) {
+				err = pd_add(line, &loc, write, val);
+				if (err)
+					return err;
+			}
+		}
+	}
+
+	return line->n ? 0 : -EINVAL;
+}
+
+static int pd_submit(struct pd_line *line)
+{
+	struct pd_sub *subs;
+	int i, j, n = 0;
+
+	subs = calloc(line->n, sizeof(*subs));
+	if (!subs)
+		return -ENOMEM;
+
+	/* one share per bus, counted before any worker can finish one */
+	for (i = 0; i < line->n; i++) {
+		line->ops[i].bus = pd_bus_get(line->ops[i].loc.ifnam);
+		if (!line->ops[i].bus) {
+			line->ops[i].err = -ENODEV;
+			continue;
+		}
+
+		for (j = 0; j < n && subs[j].bus != line->ops[i].bus; j++);
+		if (j == n) {
+			subs[n].line = line;
+			subs[n++].bus = line->ops[i].bus;
+		}
+	}
+
+	line->pending = n;
+
+	for (i = 0; i < n; i++) {
+		pthread_mutex_lock(&subs[i].bus->lock);
+		*subs[i].bus->tail = &subs[i];
+		subs[i].bus->tail = &subs[i].next;
+		pthread_cond_signal(&subs[i].bus->cond);
+		pthread_mutex_unlock(&subs[i].bus->lock);
+	}
+
+	pthread_mutex_lock(&line->lock);
+	while (line->pending)
+		pthread_cond_wait(&line->done, &line->lock);
+	pthread_mutex_unlock(&line->lock);
+
+	free(subs);
+	return 0;
+}
+
+static void pd_serve(char *text, FILE *out)
+{
+	struct pd_line line = { .n = 0 };
+	struct pd_op *op;
+	int err, i;
+
+	pthread_mutex_init(&line.lock, NULL);
+	pthread_cond_init(&line.done, NULL);
+
+	__atomic_fetch_add(&pd.lines, 1, __ATOMIC_RELAXED);
+
+	err = pd_parse(&line, text) ? : pd_submit(&line);
+	if (err) {
+		fprintf(out, "%d\n", err);
+		goto out;
+	}
+
+	for (i = 0; i < line.n; i++) {
+		op = &line.ops[i];
+
+		if (i)
+			fputc(' ', out);
+
+		if (op->err)
+			fprintf(out, "%d", op->err);
+		else if (op->write)
+			fputs("ok", out);
+		else
+			fprintf(out, "0x%.4x", op->val);
+	}
+	fputc('\n', out);
+out:
+	free(line.ops);
+	pthread_cond_destroy(&line.done);
+	pthread_mutex_destroy(&line.lock);
+}
+
+static void *pd_client(void *arg)
+{
+	int fd = (intptr_t)arg;
+	FILE *in, *out;
+	char *text = NULL;
+	size_t size = 0;
+
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+	if (!in || !out)
+		goto out;
+
+	while (getline(&text, &size, in) > 0) {
+		pd_serve(text, out);
+		if (fflush(out))
+			break;
+	}
+out:
+	free(text);
+	if (out)
+		fclose(out);
+	if (in)
+		fclose(in);
+	else
+		close(fd);
+	return NULL;
+}
+
+static void pd_sig(int signo)
+{
+	(void)signo;
+
+	pd.stop = 1;
+}
+
+static int pd_listen(const char *path)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	int sd;
+
+	if (strlen(path) >= sizeof(sun.sun_path))
+		return -ENAMETOOLONG;
+
+	strcpy(sun.sun_path, path);
+
+	sd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sd < 0)
+		return -errno;
+
+	unlink(path);
+	if (bind(sd, (struct sockaddr *)&sun, sizeof(sun)) ||
+	    listen(sd, SOMAXCONN)) {
+		close(sd);
+		return -errno;
+	}
+
+	return sd;
+}
+
+int phytool_daemon(struct applet *a, int argc, char **argv)
+{
+	struct sigaction sa = { .sa_handler = pd_sig };
+	const char *path = PD_SOCKET;
+	pthread_t tid;
+	int err, fd, sd;
+
+	pd.a = a;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-S")) {
+			err = opstat_enable();
+			if (err) {
+				fprintf(stderr, "error: unable to enable stats (%d)\n",
+					err);
+				return 1;
+			}
+
+			argc--, argv++;
+			continue;
+		}
+
+		if (!strcmp(argv[0], "-b") && argc > 1) {
+			err = mdio_backend_select(argv[1]);
+			if (err) {
+				fprintf(stderr, "error: unable to use backend \"%s\" (%d)\n",
+					argv[1], err);
+				return 1;
+			}
+		} else if (!strcmp(argv[0], "-s") && argc > 1) {
+			path = argv[1];
+		} else if (!strcmp(argv[0], "-c") && argc > 1) {
+			if (parse_interval(argv[1], &pd.ttl))
+				return 1;
+		} else {
+			return a->usage(1);
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (argc)
+		return a->usage(1);
+
+	sd = pd_listen(path);
+	if (sd < 0) {
+		fprintf(stderr, "error: %s: unable to listen (%d)\n", path, sd);
+		return 1;
+	}
+
+	/* no SA_RESTART, to get out of accept() */
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!pd.stop) {
+		fd = accept4(sd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			fprintf(stderr, "error: accept (%d)\n", -errno);
+			break;
+		}
+
+		if (pthread_create(&tid, NULL, pd_client, (void *)(intptr_t)fd)) {
+			close(fd);
+			continue;
+		}
+
+		pthread_detach(tid);
+	}
+
+	close(sd);
+	unlink(path);
+
+	fprintf(stderr, "requests:%lu reads:%lu transactions:%lu\n",
+		pd.lines, pd.reads, pd.xfers);
+	return pd.stop ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+const char *reg_field_enum(const struct reg_field *f, uint16_t val)
+{
+	int i;
+
+	for (i = 0; i < f->nbits; i++) {
+		if (f->bits[i].val == (val & f->mask))
+			return f->bits[i].name;
+	}
+
+	return NULL;
+}
+
+unsigned reg_field_val(const struct reg_field *f, uint16_t val)
+{
+	return (val & f->mask) >> __builtin_ctz(f->mask);
+}
+
+/* Walk every described field of the register at loc, handing each one
+ * to the visitor. Registers without a description only get the reg
+ * callback, with a NULL desc. The tables describe page 0, so registers
+ * on other pages never have one. */
+void reg_decode(const struct reg_table *t, const struct loc *loc, uint16_t val,
+		const struct reg_visitor *v, void *arg)
+{
+	const struct reg_desc *rd = NULL;
+	uint16_t reg = loc->reg;
+	int i;
+
+	if (t && reg < 32 && t->regs[reg].name &&
+	    !(loc_is_paged(loc) && loc->page))
+		rd = &t->regs[reg];
+
+	v->reg(arg, t, rd, reg, val);
+
+	for (i = 0; rd && i < rd->nfields; i++)
+		v->field(arg, &rd->fields[i], val);
+
+	if (v->end)
+		v->end(arg);
+}
+
+struct reg_text {
+	const struct loc *loc;
+	int indent;
+};
+
+static void reg_text_reg(void *arg, const struct reg_table *t,
+			 const struct reg_desc *rd, uint16_t reg, uint16_t val)
+{
+	struct reg_text *rt = arg;
+	char page[8] = "";
+
+	if (loc_is_paged(rt->loc))
+		snprintf(page, sizeof(page), "%u.", rt->loc->page);
+
+	if (rd)
+		printf("%*s%s: reg:%s(%s0x%.2x) val:0x%.4x\n", rt->indent, "",
+		       t->prefix, rd->name, page, reg, val);
+	else
+		printf("%*s%s: reg:%s0x%.2x val:0x%.4x\n", rt->indent, "",
+		       t->prefix, page, reg, val);
+}
+
+static void reg_text_field(void *arg, const struct reg_field *f, uint16_t val)
+{
+	struct reg_text *rt = arg;
+	const char *str;
+	int i;
+
+	print_attr_name(f->name, rt->indent + INDENT);
+
+	switch (f->kind) {
+	case REG_FLAGS:
+		for (i = 0; i < f->nbits; i++) {
+			if (i)
+				putchar(' ');
+
+			print_bool(f->bits[i].name, val & f->bits[i].val);
+		}
+		putchar('\n');
+		break;
+	case REG_ENUM:
+		str = reg_field_enum(f, val);
+		if (str)
+			puts(str);
+		else
+			printf("0x%x\n", val & f->mask);
+		break;
+	case REG_HEX:
+		printf("0x%x\n", reg_field_val(f, val));
+		break;
+	}
+}
+
+static const struct reg_visitor reg_text = {
+	.reg   = reg_text_reg,
+	.field = reg_text_field,
+};
+
+/* JSON gets one record per register, with a member per field or flag.
+ * CSV gets one row per field or flag, so the columns never change. */
+struct reg_emit {
+	const struct loc *loc;
+	const struct reg_desc *rd;
+	uint16_t val;
+	int rows;
+};
+
+static void reg_emit_head(struct reg_emit *re)
+{
+	emit_begin();
+	emit_loc("loc", re->loc);
+	if (loc_is_paged(re->loc))
+		emit_uint("page", re->loc->page);
+	emit_uint("reg", re->loc->reg);
+	emit_str("name", re->rd ? re->rd->name : "");
+	emit_uint("val", re->val);
+}
+
+static void reg_emit_row(struct reg_emit *re, const char *field,
+			 const char *value)
+{
+	reg_emit_head(re);
+	emit_str("field", field);
+	emit_str("value", value);
+	emit_end();
+	re->rows++;
+}
+
+static void reg_emit_reg(void *arg, const struct reg_table *t,
+			 const struct reg_desc *rd, uint16_t reg, uint16_t val)
+{
+	struct reg_emit *re = arg;
+
+	(void)t;
+	(void)reg;
+
+	re->rd = rd;
+	re->val = val;
+
+	if (emit_fmt == EMIT_JSON)
+		reg_emit_head(re);
+}
+
+static void reg_emit_field(void *arg, const struct reg_field *f, uint16_t val)
+{
+	struct reg_emit *re = arg;
+	const char *str;
+	char key[64], num[8];
+	int i;
+
+	switch (f->kind) {
+	case REG_FLAGS:
+		for (i = 0; i < f->nbits; i++) {
+			snprintf(key, sizeof(key), "%s.%s", f->name,
+				 f->bits[i].name);
+
+			if (emit_fmt == EMIT_JSON)
+				emit_bool(key, val & f->bits[i].val);
+			else
+				reg_emit_row(re, key,
+					     (val & f->bits[i].val) ? "1" : "0");
+		}
+		return;
+	case REG_ENUM:
+		str = reg_field_enum(f, val);
+		if (!str) {
+			snprintf(num, sizeof(num), "0x%x", val & f->mask);
+			str = num;
+		}
+		break;
+	case REG_HEX:
+		snprintf(num, sizeof(num), "0x%x", reg_field_val(f, val));
+		str = num;
+		break;
+	default:
+		return;
+	}
+
+	if (emit_fmt == EMIT_JSON)
+		emit_str(f->name, str);
+	else
+		reg_emit_row(re, f->name, str);
+}
+
+static void reg_emit_end(void *arg)
+{
+	struct reg_emit *re = arg;
+
+	if (emit_fmt == EMIT_JSON)
+		emit_end();
+	else if (!re->rows)
+		reg_emit_row(re, "", "");
+}
+
+static const struct reg_visitor reg_emit = {
+	.reg   = reg_emit_reg,
+	.field = reg_emit_field,
+	.end   = reg_emit_end,
+};
+
+void reg_print(const struct reg_table *t, const struct loc *loc, uint16_t val,
+	       int indent)
+{
+	struct reg_text rt = { .loc = loc, .indent = indent };
+	struct reg_emit re = { .loc = loc };
+
+	if (emit_fmt == EMIT_TEXT)
+		reg_decode(t, loc, val, &reg_text, &rt);
+	else
+		reg_decode(t, loc, val, &reg_emit, &re);
+}
@@ -0,0 +1,121 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define DUMP_CHUNK 256
+#define DUMP_ROW   8
+
+/* Text rows are `LOC/[PAGE.]REG VAL...`, the same format as a sim
+ * image, so a dump can be replayed with `-b sim:FILE`. Binary output is
+ * the raw little-endian register values. */
+int dump_range(const struct loc *loc, int count, int binary)
+{
+	uint16_t buf[DUMP_CHUNK];
+	struct loc chunk = *loc;
+	char name[48];
+	int err, i, j, n;
+
+	loc_str(loc, name, sizeof(name));
+
+	for (; count; count -= n, chunk.reg += n) {
+		n = (count < DUMP_CHUNK) ? count : DUMP_CHUNK;
+
+		err = mdio_read_range(&chunk, buf, n);
+		if (err) {
+			fprintf(stderr, "error: phy_read (%d)\n", err);
+			return err;
+		}
+
+		if (binary) {
+			for (i = 0; i < n; i++)
+				buf[i] = htole16(buf[i]);
+
+			if (fwrite(buf, sizeof(*buf), n, stdout) != (size_t)n)
+				return -EIO;
+
+			continue;
+		}
+
+		for (i = 0; emit_fmt != EMIT_TEXT && i < n; i++) {
+			emit_begin();
+			emit_str("loc", name);
+			if (loc_is_paged(&chunk))
+				emit_uint("page", chunk.page);
+			emit_uint("reg", chunk.reg + i);
+			emit_uint("val", buf[i]);
+			emit_end();
+		}
+
+		for (i = 0; emit_fmt == EMIT_TEXT && i < n; i += DUMP_ROW) {
+			if (loc_is_paged(&chunk))
+				printf("%s/%u.0x%.2x", name, chunk.page,
+				       chunk.reg + i);
+			else
+				printf("%s/0x%.2x", name, chunk.reg + i);
+
+			for (j = i; j < n && j < i + DUMP_ROW; j++)
+				printf(" 0x%.4x", buf[j]);
+
+			putchar('\n');
+		}
+	}
+
+	return 0;
+}
+
+/* Several ranges, e.g. the pages of a Marvell PHY, go out as one dump
+ * in which each page is selected once. */
+int phytool_dump(struct applet *a, int argc, char **argv)
+{
+	struct loc loc;
+	int binary = 0, count;
+
+	if (argc && !strcmp(argv[0], "-b")) {
+		binary = 1;
+		argc--, argv++;
+	}
+
+	if (!argc)
+		return 1;
+
+	for (; argc; argc--, argv++) {
+		if (parse_loc_range(a, argv[0], &loc, &count, 0)) {
+			fprintf(stderr, "error: bad location format\n");
+			return 1;
+		}
+
+		/* no register given, take the whole C22 (or MMD base) space */
+		if (loc.reg == REG_SUMMARY) {
+			loc.reg = 0;
+			count = 32;
+		}
+
+		if (dump_range(&loc, count, binary))
+			return 1;
+	}
+
+	return 0;
+}
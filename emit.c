@@ -0,0 +1,207 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define EMIT_BUF  (1 << 16)
+#define EMIT_LINE 1024
+
+enum emit_format emit_fmt = EMIT_TEXT;
+
+static struct {
+	int color;
+	char buf[EMIT_BUF];
+
+	/* csv only, the header is repeated whenever the columns change */
+	char hdr[EMIT_LINE];
+	char last_hdr[EMIT_LINE];
+	char row[EMIT_LINE];
+
+	int nkeys;
+} emit;
+
+int emit_format(const char *name)
+{
+	if (!strcmp(name, "text"))
+		emit_fmt = EMIT_TEXT;
+	else if (!strcmp(name, "json"))
+		emit_fmt = EMIT_JSON;
+	else if (!strcmp(name, "csv"))
+		emit_fmt = EMIT_CSV;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+void emit_init(void)
+{
+	emit.color = isatty(STDOUT_FILENO);
+}
+
+/* Output of one-shot commands goes through a stdout buffer sized for
+ * bulk dumps. A terminal stays line buffered, so interactive use is
+ * unaffected, and commands that run on are left alone, so what they
+ * print is seen as it happens. */
+void emit_bulk(void)
+{
+	if (!emit.color)
+		setvbuf(stdout, emit.buf, _IOFBF, sizeof(emit.buf));
+}
+
+int emit_color(void)
+{
+	return emit.color;
+}
+
+void emit_sep(void)
+{
+	if (emit_fmt == EMIT_TEXT)
+		putchar('\n');
+}
+
+static void emit_append(char *line, const char *fmt, const char *str)
+{
+	size_t len = strlen(line);
+
+	snprintf(&line[len], EMIT_LINE - len, fmt, str);
+}
+
+static void emit_json_str(const char *str)
+{
+	putchar('"');
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			putchar('\\');
+
+		if ((unsigned char)*str < 0x20)
+			printf("\\u%.4x", *str);
+		else
+			putchar(*str);
+	}
+
+	putchar('"');
+}
+
+static void emit_key(const char *key)
+{
+	if (emit_fmt == EMIT_JSON) {
+		if (emit.nkeys)
+			putchar(',');
+
+		emit_json_str(key);
+		putchar(':');
+	} else {
+		emit_append(emit.hdr, emit.nkeys ? ",%s" : "%s", key);
+		if (emit.nkeys)
+			emit_append(emit.row, "%s", ",");
+	}
+
+	emit.nkeys++;
+}
+
+void emit_begin(void)
+{
+	emit.nkeys = 0;
+
+	if (emit_fmt == EMIT_JSON)
+		putchar('{');
+
+	emit.hdr[0] = emit.row[0] = '\0';
+}
+
+void emit_str(const char *key, const char *val)
+{
+	emit_key(key);
+
+	if (emit_fmt == EMIT_JSON) {
+		emit_json_str(val);
+		return;
+	}
+
+	if (!strpbrk(val, ",\"\n")) {
+		emit_append(emit.row, "%s", val);
+		return;
+	}
+
+	/* quote, doubling any quotes inside */
+	emit_append(emit.row, "%s", "\"");
+	for (; *val; val++) {
+		char c[3] = { *val, *val, '\0' };
+
+		if (*val != '"')
+			c[1] = '\0';
+
+		emit_append(emit.row, "%s", c);
+	}
+	emit_append(emit.row, "%s", "\"");
+}
+
+void emit_uint(const char *key, unsigned long val)
+{
+	char num[24];
+
+	emit_key(key);
+
+	snprintf(num, sizeof(num), "%lu", val);
+	if (emit_fmt == EMIT_JSON)
+		fputs(num, stdout);
+	else
+		emit_append(emit.row, "%s", num);
+}
+
+void emit_bool(const char *key, int on)
+{
+	emit_key(key);
+
+	if (emit_fmt == EMIT_JSON)
+		fputs(on ? "true" : "false", stdout);
+	else
+		emit_append(emit.row, "%s", on ? "1" : "0");
+}
+
+void emit_loc(const char *key, const struct loc *loc)
+{
+	char name[48];
+
+	loc_str(loc, name, sizeof(name));
+	emit_str(key, name);
+}
+
+void emit_end(void)
+{
+	if (emit_fmt == EMIT_JSON) {
+		puts("}");
+		return;
+	}
+
+	if (strcmp(emit.hdr, emit.last_hdr)) {
+		puts(emit.hdr);
+		strcpy(emit.last_hdr, emit.hdr);
+	}
+
+	puts(emit.row);
+}
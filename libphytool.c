@@ -0,0 +1,368 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "libphytool.h"
+#include "phytool.h"
+
+_Static_assert(sizeof(((struct phytool_loc *)0)->ifnam) == IFNAMSIZ,
+	       "struct phytool_loc out of sync with struct loc");
+
+struct phytool_ctx {
+	struct mdio_ctx mdio;
+};
+
+struct phytool_shm {
+	struct shm_seg seg;
+};
+
+static void loc_in(struct loc *loc, const struct phytool_loc *ploc)
+{
+	memcpy(loc->ifnam, ploc->ifnam, IFNAMSIZ);
+	loc->phy_id = ploc->phy_id;
+	loc->reg = ploc->reg;
+	loc->page = ploc->page;
+	loc->flags  = (ploc->flags & PHYTOOL_LOC_PAGED) ? LOC_F_PAGE : 0;
+	loc->flags |= (ploc->flags & PHYTOOL_LOC_MMD) ? LOC_F_MMD : 0;
+	loc->flags |= (ploc->flags & PHYTOOL_LOC_SMI) ? LOC_F_SMI : 0;
+}
+
+static void loc_out(struct phytool_loc *ploc, const struct loc *loc)
+{
+	memcpy(ploc->ifnam, loc->ifnam, IFNAMSIZ);
+	ploc->phy_id = loc->phy_id;
+	ploc->reg = loc->reg;
+	ploc->page = loc->page;
+	ploc->flags  = loc_is_paged(loc) ? PHYTOOL_LOC_PAGED : 0;
+	ploc->flags |= loc_is_mmd(loc) ? PHYTOOL_LOC_MMD : 0;
+	ploc->flags |= loc_is_smi(loc) ? PHYTOOL_LOC_SMI : 0;
+}
+
+struct phytool_ctx *phytool_ctx_open(const char *backend)
+{
+	struct phytool_ctx *ctx;
+	int err;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	err = mdio_ctx_init(&ctx->mdio, backend);
+	if (err) {
+		free(ctx);
+		errno = -err;
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void phytool_ctx_close(struct phytool_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	mdio_ctx_close(&ctx->mdio);
+	free(ctx);
+}
+
+int phytool_ctx_restore(struct phytool_ctx *ctx, const char *ifnam)
+{
+	return mdio_ctx_restore(&ctx->mdio, ifnam);
+}
+
+int phytool_loc_parse(const char *text, enum phytool_syntax syntax,
+		      struct phytool_loc *ploc)
+{
+	struct loc loc = { .ifnam = { 0 } };
+	char *copy;
+	int err;
+
+	copy = strdup(text);
+	if (!copy)
+		return -ENOMEM;
+
+	if (syntax == PHYTOOL_SYNTAX_MV6)
+		err = mv6tool_parse_loc(copy, &loc, 0);
+	else
+		err = phytool_parse_loc(copy, &loc, 0);
+
+	free(copy);
+	if (err)
+		return -EINVAL;
+
+	loc_out(ploc, &loc);
+	return 0;
+}
+
+int phytool_loc_str(const struct phytool_loc *ploc, char *buf, size_t len)
+{
+	struct loc loc;
+
+	loc_in(&loc, ploc);
+	return loc_str(&loc, buf, len);
+}
+
+int phytool_ctx_read(struct phytool_ctx *ctx, const struct phytool_loc *ploc,
+		     uint16_t *val)
+{
+	struct loc loc;
+
+	loc_in(&loc, ploc);
+	return mdio_ctx_read(&ctx->mdio, &loc, val);
+}
+
+int phytool_ctx_write(struct phytool_ctx *ctx, const struct phytool_loc *ploc,
+		      uint16_t val)
+{
+	struct loc loc;
+
+	loc_in(&loc, ploc);
+	return mdio_ctx_write(&ctx->mdio, &loc, val);
+}
+
+int phytool_ctx_id(struct phytool_ctx *ctx, const struct phytool_loc *ploc,
+		   uint32_t *id)
+{
+	uint16_t ids[2];
+	struct loc loc;
+	int err;
+
+	loc_in(&loc, ploc);
+	loc.reg = MII_PHYSID1;
+
+	err = mdio_ctx_read_range(&ctx->mdio, &loc, ids, 2);
+	if (err)
+		return err;
+
+	*id = (ids[0] << 16) | ids[1];
+	return 0;
+}
+
+static int batch_run(const struct phytool_loc *locs, int n)
+{
+	int i;
+
+	for (i = 1; i < n; i++) {
+		if (locs[i].phy_id != locs[0].phy_id ||
+		    locs[i].reg != locs[0].reg + i ||
+		    locs[i].page != locs[0].page ||
+		    locs[i].flags != locs[0].flags ||
+		    strncmp(locs[i].ifnam, locs[0].ifnam, IFNAMSIZ))
+			break;
+	}
+
+	return i;
+}
+
+int phytool_ctx_read_batch(struct phytool_ctx *ctx,
+			   const struct phytool_loc *locs, uint16_t *vals,
+			   int *errs, int n)
+{
+	int err, e, first = 0, i, j, run;
+	struct loc loc;
+
+	for (i = 0; i < n; i += run) {
+		run = batch_run(&locs[i], n - i);
+
+		loc_in(&loc, &locs[i]);
+		err = mdio_ctx_read_range(&ctx->mdio, &loc, &vals[i], run);
+
+		/* a range stops at the first failure, read every entry of
+		 * it again to find out which ones failed */
+		for (j = i; j < i + run; j++) {
+			e = err;
+			if (err && run > 1) {
+				loc_in(&loc, &locs[j]);
+				e = mdio_ctx_read(&ctx->mdio, &loc, &vals[j]);
+			}
+
+			if (errs)
+				errs[j] = e;
+
+			first = first ? : e;
+		}
+	}
+
+	return first;
+}
+
+int phytool_ctx_write_batch(struct phytool_ctx *ctx,
+			    const struct phytool_loc *locs,
+			    const uint16_t *vals, int *errs, int n)
+{
+	int err = 0, i;
+	struct loc loc;
+
+	for (i = 0; i < n; i++) {
+		if (!err) {
+			loc_in(&loc, &locs[i]);
+			err = mdio_ctx_write(&ctx->mdio, &loc, vals[i]);
+
+			if (errs)
+				errs[i] = err;
+		} else if (errs) {
+			errs[i] = -ECANCELED;
+		}
+	}
+
+	return err;
+}
+
+struct decode_cb {
+	phytool_field_fn fn;
+	void *arg;
+	int known;
+};
+
+static void decode_cb_reg(void *arg, const struct reg_table *t,
+			  const struct reg_desc *rd, uint16_t reg, uint16_t val)
+{
+	struct decode_cb *dc = arg;
+
+	(void)t;
+	(void)reg;
+	(void)val;
+
+	if (!rd)
+		return;
+
+	dc->known = 1;
+	dc->fn(dc->arg, NULL, rd->name);
+}
+
+static void decode_cb_field(void *arg, const struct reg_field *f, uint16_t val)
+{
+	struct decode_cb *dc = arg;
+	const char *str;
+	char key[64], num[8];
+	int i;
+
+	switch (f->kind) {
+	case REG_FLAGS:
+		for (i = 0; i < f->nbits; i++) {
+			snprintf(key, sizeof(key), "%s.%s", f->name,
+				 f->bits[i].name);
+			dc->fn(dc->arg, key, (val & f->bits[i].val) ? "1" : "0");
+		}
+		return;
+	case REG_ENUM:
+		str = reg_field_enum(f, val);
+		if (!str) {
+			snprintf(num, sizeof(num), "0x%x", val & f->mask);
+			str = num;
+		}
+		break;
+	case REG_HEX:
+		snprintf(num, sizeof(num), "0x%x", reg_field_val(f, val));
+		str = num;
+		break;
+	default:
+		return;
+	}
+
+	dc->fn(dc->arg, f->name, str);
+}
+
+static const struct reg_visitor decode_cb = {
+	.reg   = decode_cb_reg,
+	.field = decode_cb_field,
+};
+
+int phytool_reg_decode(const struct phytool_loc *ploc, uint16_t val,
+		       enum phytool_syntax syntax, phytool_field_fn fn,
+		       void *arg)
+{
+	struct decode_cb dc = { .fn = fn, .arg = arg };
+	const struct reg_table *t = &reg_ieee;
+	struct loc loc;
+
+	loc_in(&loc, ploc);
+
+	if (syntax == PHYTOOL_SYNTAX_MV6 && loc_is_c45(&loc))
+		t = mv6_reg_table(&loc);
+
+	reg_decode(t, &loc, val, &decode_cb, &dc);
+	return dc.known ? 0 : -ENOENT;
+}
+
+struct phytool_shm *phytool_shm_open(const char *name)
+{
+	struct phytool_shm *shm;
+	int err;
+
+	shm = calloc(1, sizeof(*shm));
+	if (!shm)
+		return NULL;
+
+	err = shm_attach(&shm->seg, name ? : SHM_DEFAULT);
+	if (err) {
+		free(shm);
+		errno = -err;
+		return NULL;
+	}
+
+	return shm;
+}
+
+void phytool_shm_close(struct phytool_shm *shm)
+{
+	if (!shm)
+		return;
+
+	shm_detach(&shm->seg);
+	free(shm);
+}
+
+int phytool_shm_count(const struct phytool_shm *shm)
+{
+	return shm_count(&shm->seg);
+}
+
+int phytool_shm_find(const struct phytool_shm *shm,
+		     const struct phytool_loc *ploc)
+{
+	struct loc loc;
+
+	loc_in(&loc, ploc);
+	return shm_find(&shm->seg, &loc);
+}
+
+int phytool_shm_read(const struct phytool_shm *shm, int i,
+		     struct phytool_shm_val *pval)
+{
+	struct shm_val v;
+	int err;
+
+	err = shm_get(&shm->seg, i, &v);
+	if (err)
+		return err;
+
+	loc_out(&pval->loc, &v.loc);
+	pval->val = v.val;
+	pval->err = v.err;
+	pval->gen = v.gen;
+	pval->stamp = v.stamp;
+	return 0;
+}
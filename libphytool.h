@@ -0,0 +1,130 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LIBPHYTOOL_H
+#define __LIBPHYTOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PHYTOOL_API __attribute__((visibility("default")))
+
+#define PHYTOOL_REG_SUMMARY 0xffff
+
+#define PHYTOOL_LOC_PAGED 0x01	/* REG is on Marvell page PAGE */
+#define PHYTOOL_LOC_MMD   0x02	/* C45 through C22 registers 13/14 */
+#define PHYTOOL_LOC_SMI   0x04	/* mv6 PHY through the Global2 SMI unit */
+
+/* Everything returning int returns 0 on success, or a negative errno. */
+
+/* Owns the backend selection and the ioctl socket. Use one per thread. */
+struct phytool_ctx;
+
+struct phytool_loc {
+	char     ifnam[16];	/* IFNAMSIZ */
+	uint16_t phy_id;	/* C22 address, or mdio_phy_id_c45() */
+	uint16_t reg;
+
+	uint8_t  page;
+	uint8_t  flags;		/* PHYTOOL_LOC_* */
+};
+
+enum phytool_syntax {
+	PHYTOOL_SYNTAX_PHY,	/* IFACE/ADDR[/[PAGE.]REG], as phytool */
+	PHYTOOL_SYNTAX_MV6,	/* also switch addressing, as mv6tool */
+};
+
+/* BACKEND is as for --backend, NULL means ioctl. The sim and replay
+ * stores are process wide, whichever handle loaded them last wins.
+ * Returns NULL with errno set on failure. */
+PHYTOOL_API struct phytool_ctx *phytool_ctx_open(const char *backend);
+PHYTOOL_API void phytool_ctx_close(struct phytool_ctx *ctx);
+
+/* Paged locations only write the page register when the page changes.
+ * The original page is put back on the next plain access to the PHY,
+ * on close, or here for every PHY on IFNAM (NULL for all of them). */
+PHYTOOL_API int phytool_ctx_restore(struct phytool_ctx *ctx, const char *ifnam);
+
+PHYTOOL_API int phytool_loc_parse(const char *text, enum phytool_syntax syntax,
+				  struct phytool_loc *loc);
+PHYTOOL_API int phytool_loc_str  (const struct phytool_loc *loc, char *buf,
+				  size_t len);
+
+PHYTOOL_API int phytool_ctx_read (struct phytool_ctx *ctx,
+				  const struct phytool_loc *loc, uint16_t *val);
+PHYTOOL_API int phytool_ctx_write(struct phytool_ctx *ctx,
+				  const struct phytool_loc *loc, uint16_t val);
+PHYTOOL_API int phytool_ctx_id   (struct phytool_ctx *ctx,
+				  const struct phytool_loc *loc, uint32_t *id);
+
+/* Runs of consecutive registers on the same device are read in one
+ * go. Every entry is attempted, ERRS (optional) gets each one's
+ * status, and the first failure is returned. */
+PHYTOOL_API int phytool_ctx_read_batch(struct phytool_ctx *ctx,
+				       const struct phytool_loc *locs,
+				       uint16_t *vals, int *errs, int n);
+
+/* Writes are done in order and stop at the first failure, the entries
+ * after it get -ECANCELED in ERRS (optional). */
+PHYTOOL_API int phytool_ctx_write_batch(struct phytool_ctx *ctx,
+					const struct phytool_loc *locs,
+					const uint16_t *vals, int *errs, int n);
+
+/* Called with the register's name first, FIELD is then NULL, and then
+ * once per field. Flags are split into one "field.flag" call per bit
+ * with VALUE "0" or "1". */
+typedef void (*phytool_field_fn)(void *arg, const char *field,
+				 const char *value);
+
+/* Returns -ENOENT for registers without a description. */
+PHYTOOL_API int phytool_reg_decode(const struct phytool_loc *loc, uint16_t val,
+				   enum phytool_syntax syntax,
+				   phytool_field_fn fn, void *arg);
+
+/* Registers published by `phytool publish`. Reads are lock-free and
+ * never touch the bus, or make a system call. */
+struct phytool_shm;
+
+struct phytool_shm_val {
+	struct phytool_loc loc;
+	uint16_t val;
+	int      err;	/* of the last read, VAL is from the one before */
+	uint32_t gen;	/* bumped on every change, 0 until the first read */
+	uint64_t stamp;	/* CLOCK_MONOTONIC ns of the last read */
+};
+
+/* NAME as given to publish, NULL means the default. Returns NULL with
+ * errno set on failure, EAGAIN if the publisher is still starting. */
+PHYTOOL_API struct phytool_shm *phytool_shm_open(const char *name);
+PHYTOOL_API void phytool_shm_close(struct phytool_shm *shm);
+
+PHYTOOL_API int phytool_shm_count(const struct phytool_shm *shm);
+
+/* Returns the index of LOC, for phytool_shm_read() */
+PHYTOOL_API int phytool_shm_find(const struct phytool_shm *shm,
+				 const struct phytool_loc *loc);
+PHYTOOL_API int phytool_shm_read(const struct phytool_shm *shm, int i,
+				 struct phytool_shm_val *val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* __LIBPHYTOOL_H */
@@ -0,0 +1,313 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define LINKMON_RING 4096
+
+#define MV6_PS_LINK 0x0800
+
+struct linkmon_port {
+	struct loc loc;
+	char name[48];
+
+	uint16_t mask;
+	int latched;
+
+	int link;
+	uint64_t flaps;
+};
+
+struct linkmon_event {
+	uint64_t ts;
+	int port;
+	int link;
+	int latched;
+};
+
+/* Single producer (the sampler) and single consumer (the writer), so
+ * head and tail only need to be published in the right order. */
+struct linkmon_ring {
+	struct linkmon_event ev[LINKMON_RING];
+	unsigned head;
+	unsigned tail;
+	uint64_t dropped;
+};
+
+struct linkmon {
+	struct linkmon_port *ports;
+	int n;
+
+	struct linkmon_ring ring;
+	int done;
+
+	uint64_t samples;
+};
+
+static volatile sig_atomic_t linkmon_stop;
+
+static void linkmon_sig(int signo)
+{
+	(void)signo;
+	linkmon_stop = 1;
+}
+
+static void linkmon_push(struct linkmon *lm, uint64_t ts, int port, int link,
+			 int latched)
+{
+	struct linkmon_ring *r = &lm->ring;
+	unsigned head = r->head;
+
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == LINKMON_RING) {
+		r->dropped++;
+		return;
+	}
+
+	r->ev[head % LINKMON_RING] = (struct linkmon_event) {
+		.ts = ts, .port = port, .link = link, .latched = latched
+	};
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void *linkmon_writer(void *arg)
+{
+	struct linkmon *lm = arg;
+	struct linkmon_ring *r = &lm->ring;
+	struct timespec idle = { .tv_nsec = 1000000 };
+	struct linkmon_event *ev;
+	unsigned head, tail = r->tail;
+	int done;
+
+	for (;;) {
+		done = __atomic_load_n(&lm->done, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+		if (tail == head) {
+			if (done)
+				break;
+
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		for (; tail != head; tail++) {
+			ev = &r->ev[tail % LINKMON_RING];
+
+			printf("[%llu.%.9llu] %s link:%s%s\n",
+			       (unsigned long long)(ev->ts / 1000000000),
+			       (unsigned long long)(ev->ts % 1000000000),
+			       lm->ports[ev->port].name,
+			       ev->link ? "up" : "down",
+			       ev->latched ? " (latched)" : "");
+		}
+
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+		fflush(stdout);
+	}
+
+	return NULL;
+}
+
+static int linkmon_sample(struct linkmon *lm, int i)
+{
+	struct linkmon_port *p = &lm->ports[i];
+	uint16_t val;
+	uint64_t ts;
+	int err, link;
+
+	err = mdio_read(&p->loc, &val);
+	ts = mono_ns();
+	if (err)
+		return err;
+
+	link = !!(val & p->mask);
+
+	/* A latched-low bit that reads low may only be telling us that
+	 * the link dropped since the last sample. The second read gives
+	 * the current state, if it is up we caught a short flap. */
+	if (!link && p->latched) {
+		err = mdio_read(&p->loc, &val);
+		if (err)
+			return err;
+
+		if (val & p->mask) {
+			if (p->link > 0) {
+				linkmon_push(lm, ts, i, 0, 1);
+				p->flaps++;
+			}
+
+			linkmon_push(lm, mono_ns(), i, 1, 0);
+			p->link = 1;
+			return 0;
+		}
+	}
+
+	if (link != p->link) {
+		if (!link && p->link > 0)
+			p->flaps++;
+
+		linkmon_push(lm, ts, i, link, 0);
+		p->link = link;
+	}
+
+	return 0;
+}
+
+static int linkmon_add(struct applet *a, struct linkmon *lm, char *text)
+{
+	struct linkmon_port *p;
+
+	p = realloc(lm->ports, (lm->n + 1) * sizeof(*p));
+	if (!p)
+		return -ENOMEM;
+
+	lm->ports = p;
+	p = &lm->ports[lm->n];
+	memset(p, 0, sizeof(*p));
+
+	if (a->parse_loc(text, &p->loc, 0))
+		return -EINVAL;
+
+	loc_str(&p->loc, p->name, sizeof(p->name));
+	p->link = -1;
+
+	/* switch ports have live port status, no latching, their PHYs
+	 * (phyN, IFACE/phy, smiN, serdes) a plain BMSR */
+	if (a->print == print_mv6tool && loc_is_c45(&p->loc) &&
+	    !loc_is_smi(&p->loc) && loc_c45_dev(&p->loc) >= 0x10) {
+		p->loc.reg = 0;
+		p->mask = MV6_PS_LINK;
+	} else {
+		p->loc.reg = MII_BMSR;
+		p->mask = BMSR_LSTATUS;
+		p->latched = 1;
+	}
+
+	lm->n++;
+	return 0;
+}
+
+static void linkmon_next(struct timespec *ts, uint64_t interval)
+{
+	uint64_t next = (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+
+	next += interval;
+
+	/* fell behind, restart the schedule from now instead of bursting */
+	if (next < mono_ns())
+		next = mono_ns() + interval;
+
+	ts->tv_sec = next / 1000000000;
+	ts->tv_nsec = next % 1000000000;
+}
+
+int phytool_linkmon(struct applet *a, int argc, char **argv)
+{
+	struct linkmon *lm;
+	struct sigaction sa;
+	struct timespec next;
+	uint64_t interval = 1000000, duration = 0, end = 0;
+	pthread_t writer;
+	int err = 0, i;
+
+	while (argc && argv[0][0] == '-') {
+		if (argc < 2)
+			return 1;
+
+		if (!strcmp(argv[0], "-i")) {
+			if (parse_interval(argv[1], &interval))
+				return 1;
+		} else if (!strcmp(argv[0], "-d")) {
+			if (parse_interval(argv[1], &duration))
+				return 1;
+		} else {
+			return 1;
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (!argc)
+		return 1;
+
+	/* the ring is too large for the stack */
+	lm = calloc(1, sizeof(*lm));
+	if (!lm)
+		return 1;
+
+	for (; argc; argc--, argv++) {
+		err = linkmon_add(a, lm, argv[0]);
+		if (err) {
+			fprintf(stderr, "error: bad location format\n");
+			goto out;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = linkmon_sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	err = -pthread_create(&writer, NULL, linkmon_writer, lm);
+	if (err)
+		goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	if (duration)
+		end = mono_ns() + duration;
+
+	while (!linkmon_stop && (!end || mono_ns() < end)) {
+		for (i = 0; !err && i < lm->n; i++)
+			err = linkmon_sample(lm, i);
+
+		if (err) {
+			fprintf(stderr, "error: phy_read (%d)\n", err);
+			break;
+		}
+
+		lm->samples++;
+
+		linkmon_next(&next, interval);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	__atomic_store_n(&lm->done, 1, __ATOMIC_RELEASE);
+	pthread_join(writer, NULL);
+
+	fprintf(stderr, "samples:%llu dropped:%llu\n",
+		(unsigned long long)lm->samples,
+		(unsigned long long)lm->ring.dropped);
+	for (i = 0; i < lm->n; i++)
+		fprintf(stderr, "%s flaps:%llu\n", lm->ports[i].name,
+			(unsigned long long)lm->ports[i].flaps);
+out:
+	free(lm->ports);
+	free(lm);
+	return err ? 1 : 0;
+}
@@ -0,0 +1,329 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+static int parse_phy_id(char *text, struct loc *loc)
+{
+	unsigned long port, dev;
+	char *end;
+
+	port = strtoul(text, &end, 0);
+	if (!end[0]) {
+		/* simple phy address */
+		loc->phy_id = port;
+		return 0;
+	}
+
+	if (end[0] != ':') {
+		/* not clause 45 either */
+		return 1;
+	}
+
+	/* PORT:mmdDEV, clause 45 through the C22 MMD registers */
+	end++;
+	if (!strncmp(end, "mmd", 3)) {
+		loc->flags |= LOC_F_MMD;
+		end += 3;
+	}
+
+	dev = strtoul(end, &end, 0);
+	if (end[0])
+		return 1;
+
+	loc->phy_id = mdio_phy_id_c45(port, dev);
+	return 0;
+}
+
+static int parse_switch_id(const char *dev, int *swid, char *ifnam)
+{
+	char *end;
+
+	*swid = strtol(dev, &end, 0);
+	if (end == dev || *end || *swid < 0)
+		return -EINVAL;
+
+	return topo_switch_if(*swid, ifnam);
+}
+
+static int parse_switch_addr(const char *addr, int *swaddr, struct loc *loc)
+{
+	const char *num;
+	int offs;
+
+	if (strstr(addr, "phy") == addr) {
+		num = &addr[3];
+		offs = 0x0;
+	} else if (strstr(addr, "smi") == addr) {
+		/* phyN, through the Global2 SMI PHY command unit */
+		num = &addr[3];
+		offs = 0x0;
+		loc->flags |= LOC_F_SMI;
+	} else if (strstr(addr, "port") == addr) {
+		num = &addr[4];
+		offs = 0x10;
+	} else if (!strcmp(addr, "serdes")) {
+		*swaddr = 0xf;
+		return 0;
+	} else if (strstr(addr, "global") == addr) {
+		num = &addr[6];
+		offs = 0x1a;
+	} else {
+		num = addr;
+		offs = 0x0;
+	}
+
+	*swaddr = strtol(num, NULL, 0);
+	if (*swaddr < 0)
+		return -EINVAL;
+
+	*swaddr += offs;
+	return 0;
+}
+
+static int loc_segments(char *text, char **a, char **b, char **c)
+{
+	char *save;
+
+	*a = strtok_r(text, "/", &save);
+	if (!*a)
+		return 0;
+
+	*b = strtok_r(NULL, "/", &save);
+	if (!*b)
+		return 1;
+
+	*c = strtok_r(NULL, "/", &save);
+	if (!*c)
+		return 2;
+
+	return 3;
+}
+
+/* REG, or PAGE.REG for registers behind the page select register of
+ * Marvell PHYs. Pages only exist on clause 22 PHYs. */
+static int parse_reg(char *text, struct loc *loc)
+{
+	unsigned long page;
+	char *dot;
+
+	if (!text) {
+		loc->reg = REG_SUMMARY;
+		return 0;
+	}
+
+	dot = strchr(text, '.');
+	if (!dot) {
+		loc->reg = strtoul(text, NULL, 0);
+
+		/* the SMI PHY command only has room for C22 registers */
+		if (loc_is_smi(loc) && loc->reg > 0x1f)
+			return -EINVAL;
+
+		return 0;
+	}
+
+	if (loc_is_c45(loc))
+		return -EINVAL;
+
+	page = strtoul(text, NULL, 0);
+	if (page > 0xff)
+		return -EINVAL;
+
+	loc->page = page;
+	loc->flags |= LOC_F_PAGE;
+	loc->reg = strtoul(dot + 1, NULL, 0);
+	return 0;
+}
+
+static int phytool_parse_loc_segs(char *dev, char *addr, char *reg,
+				  struct loc *loc)
+{
+	int err;
+
+	strncpy(loc->ifnam, dev, IFNAMSIZ - 1);
+
+	err = parse_phy_id(addr, loc);
+	if (err)
+		return err;
+
+	return parse_reg(reg, loc);
+}
+
+int phytool_parse_loc(char *text, struct loc *loc, int strict)
+{
+	char *dev = NULL, *addr = NULL, *reg = NULL;
+	int segs;
+
+	memset(loc, 0, sizeof(*loc));
+
+	segs = loc_segments(text, &dev, &addr, &reg);
+	if (segs < (strict ? 3 : 2))
+		return -EINVAL;
+
+	return phytool_parse_loc_segs(dev, addr, reg, loc);
+}
+
+static int mv6tool_parse_loc_if(char *dev, char *addr, char *reg,
+				struct loc *loc)
+{
+	int err, phy_port, phy_dev;
+
+	err = topo_if_port(dev, &phy_port, &phy_dev);
+	if (err)
+		return err;
+
+	strncpy(loc->ifnam, dev, IFNAMSIZ - 1);
+
+	if (!addr || !strcmp(addr, "port"))
+		phy_dev += 0x10;
+	else if (!strcmp(addr, "phy"))
+		phy_dev += 0;
+	else if (!strcmp(addr, "smi"))
+		loc->flags |= LOC_F_SMI;
+	else
+		return -EINVAL;
+
+	loc->phy_id = mdio_phy_id_c45(phy_port, phy_dev);
+	return parse_reg(reg, loc);
+}
+
+int mv6tool_parse_loc(char *text, struct loc *loc, int strict)
+{
+	char *dev = NULL, *addr = NULL, *reg = NULL;
+	int phy_port, phy_dev;
+	int err, segs;
+
+	memset(loc, 0, sizeof(*loc));
+
+	segs = loc_segments(text, &dev, &addr, &reg);
+	if (segs < (strict ? 3 : 1))
+		return -EINVAL;
+
+	err = mv6tool_parse_loc_if(dev, addr, reg, loc);
+	if (!err)
+		return 0;
+
+	loc->flags = 0;
+
+	if (segs < (strict ? 3 : 2))
+		return -EINVAL;
+
+	err = parse_switch_id(dev, &phy_port, loc->ifnam);
+	if (err)
+		goto fallback;
+
+	err = parse_switch_addr(addr, &phy_dev, loc);
+	if (err)
+		goto fallback;
+
+	loc->phy_id = mdio_phy_id_c45(phy_port, phy_dev);
+	return parse_reg(reg, loc);
+fallback:
+	loc->flags = 0;
+	return phytool_parse_loc_segs(dev, addr, reg, loc);
+}
+
+/* Split off the END of a trailing START-END register range, if any,
+ * before handing the rest to the applet's parser. */
+int parse_loc_range(struct applet *a, char *text, struct loc *loc, int *count,
+		    int strict)
+{
+	char *seg = strrchr(text, '/'), *dash = NULL, *end;
+	unsigned long last;
+
+	*count = 1;
+
+	if (seg && isdigit(seg[1]))
+		dash = strchr(seg, '-');
+	if (dash)
+		*dash++ = '\0';
+
+	if (a->parse_loc(text, loc, strict))
+		return -EINVAL;
+
+	if (!dash)
+		return 0;
+
+	last = strtoul(dash, &end, 0);
+	if (*end || loc->reg == REG_SUMMARY || last > 0xffff || last < loc->reg)
+		return -EINVAL;
+
+	if (loc_is_smi(loc) && last > 0x1f)
+		return -EINVAL;
+
+	*count = last - loc->reg + 1;
+	return 0;
+}
+
+/* A switch given as DEV, as a switch port IFACE, or as any location on
+ * it, for the commands that drive one of its global units. loc is set
+ * to device dev of it. */
+int parse_switch_loc(struct applet *a, char *text, struct loc *loc, int dev)
+{
+	int swid, port;
+	char name[32];
+
+	if (!strchr(text, '/') && !topo_if_port(text, &swid, &port)) {
+		memset(loc, 0, sizeof(*loc));
+		strncpy(loc->ifnam, text, IFNAMSIZ - 1);
+		loc->phy_id = mdio_phy_id_c45(swid, dev);
+		return 0;
+	}
+
+	snprintf(name, sizeof(name), "%s/global1", text);
+	if (a->parse_loc(name, loc, 0) && a->parse_loc(text, loc, 0))
+		return -EINVAL;
+
+	if (!loc_is_c45(loc))
+		return -EINVAL;
+
+	loc->phy_id = mdio_phy_id_c45(loc_c45_port(loc), dev);
+	loc->reg = 0;
+	loc->flags = 0;
+	return 0;
+}
+
+int loc_eq(const struct loc *a, const struct loc *b)
+{
+	return a->phy_id == b->phy_id && a->reg == b->reg &&
+		a->page == b->page && a->flags == b->flags &&
+		!strncmp(a->ifnam, b->ifnam, IFNAMSIZ);
+}
+
+int loc_str(const struct loc *loc, char *buf, size_t len)
+{
+	if (loc_is_mmd(loc))
+		return snprintf(buf, len, "%.*s/0x%.2x:mmd0x%.2x", IFNAMSIZ,
+				loc->ifnam, loc_c45_port(loc), loc_c45_dev(loc));
+
+	if (loc_is_c45(loc))
+		return snprintf(buf, len, "%.*s/0x%.2x:0x%.2x", IFNAMSIZ,
+				loc->ifnam, loc_c45_port(loc), loc_c45_dev(loc));
+
+	return snprintf(buf, len, "%.*s/0x%.2x", IFNAMSIZ, loc->ifnam,
+			loc->phy_id);
+}
@@ -0,0 +1,613 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <linux/mdio.h>
+#include <linux/sockios.h>
+
+#include "phytool.h"
+
+uint64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int ioctl_sd(struct mdio_ctx *ctx)
+{
+	if (ctx->sd < 0) {
+		int new = socket(AF_INET, SOCK_DGRAM, 0), old = -1;
+
+		if (new < 0)
+			return -errno;
+
+		/* scan workers may race to open it, one of them wins */
+		if (!__atomic_compare_exchange_n(&ctx->sd, &old, new, 0,
+						 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			close(new);
+	}
+
+	return ctx->sd;
+}
+
+static int __phy_op(struct mdio_ctx *ctx, const struct loc *loc,
+		    uint16_t *val, int cmd)
+{
+	struct ifreq ifr;
+	struct mii_ioctl_data* mii = (struct mii_ioctl_data *)(&ifr.ifr_data);
+	int err, sd;
+
+	sd = ioctl_sd(ctx);
+	if (sd < 0)
+		return sd;
+
+	strncpy(ifr.ifr_name, loc->ifnam, sizeof(ifr.ifr_name));
+
+	mii->phy_id  = loc->phy_id;
+	mii->reg_num = loc->reg;
+	mii->val_in  = *val;
+	mii->val_out = 0;
+
+	err = ioctl(sd, cmd, &ifr);
+	if (err)
+		return -errno;
+
+	*val = mii->val_out;
+	return 0;
+}
+
+static int ioctl_read(struct mdio_ctx *ctx, const struct loc *loc,
+		      uint16_t *val)
+{
+	*val = 0;
+	return __phy_op(ctx, loc, val, SIOCGMIIREG);
+}
+
+static int ioctl_write(struct mdio_ctx *ctx, const struct loc *loc,
+		       uint16_t val)
+{
+	return __phy_op(ctx, loc, &val, SIOCSMIIREG);
+}
+
+/* Set up the request once and only step the register number */
+static int ioctl_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+			    uint16_t *buf, int count)
+{
+	struct ifreq ifr;
+	struct mii_ioctl_data* mii = (struct mii_ioctl_data *)(&ifr.ifr_data);
+	int i, sd;
+
+	sd = ioctl_sd(ctx);
+	if (sd < 0)
+		return sd;
+
+	strncpy(ifr.ifr_name, loc->ifnam, sizeof(ifr.ifr_name));
+	mii->phy_id = loc->phy_id;
+
+	for (i = 0; i < count; i++) {
+		mii->reg_num = loc->reg + i;
+		mii->val_out = 0;
+
+		if (ioctl(sd, SIOCGMIIREG, &ifr))
+			return -errno;
+
+		buf[i] = mii->val_out;
+	}
+
+	return 0;
+}
+
+static int ioctl_ifaces(int (*cb)(const char *ifnam, void *arg), void *arg)
+{
+	struct if_nameindex *ifs, *i;
+	int err = 0;
+
+	ifs = if_nameindex();
+	if (!ifs)
+		return -errno;
+
+	for (i = ifs; !err && i->if_index; i++)
+		err = cb(i->if_name, arg);
+
+	if_freenameindex(ifs);
+	return err;
+}
+
+struct mdio_backend ioctl_backend = {
+	.name   = "ioctl",
+	.read   = ioctl_read,
+	.write  = ioctl_write,
+	.ifaces = ioctl_ifaces,
+
+	.read_range = ioctl_read_range,
+};
+
+/* Page select state of a PHY that paged locations have been used on.
+ * ORIG is what it was set to before we came along, CUR what it is set
+ * to now. */
+struct mdio_page {
+	struct mdio_page *next;
+
+	char ifnam[IFNAMSIZ];
+	uint16_t phy_id;
+
+	uint16_t orig;
+	uint16_t cur;
+};
+
+static struct mdio_page *mdio_page_find(struct mdio_ctx *ctx,
+					const struct loc *loc)
+{
+	struct mdio_page *pg;
+
+	for (pg = __atomic_load_n(&ctx->pages, __ATOMIC_ACQUIRE); pg;
+	     pg = pg->next) {
+		if (pg->phy_id == loc->phy_id &&
+		    !strncmp(pg->ifnam, loc->ifnam, IFNAMSIZ))
+			return pg;
+	}
+
+	return NULL;
+}
+
+/* Every transaction the backends see goes through these, so that
+ * --stats counts them whichever backend is in use. Disabled, that is
+ * the test of a flag. */
+static int mdio_backend_read(struct mdio_ctx *ctx, const struct loc *loc,
+			     uint16_t *val)
+{
+	uint64_t start;
+	int err;
+
+	if (!opstat_enabled)
+		return ctx->backend->read(ctx, loc, val);
+
+	start = mono_ns();
+	err = ctx->backend->read(ctx, loc, val);
+	opstat_add(loc->ifnam, OPSTAT_READ, err, mono_ns() - start, 1);
+	return err;
+}
+
+static int mdio_backend_write(struct mdio_ctx *ctx, const struct loc *loc,
+			      uint16_t val)
+{
+	uint64_t start;
+	int err;
+
+	if (!opstat_enabled)
+		return ctx->backend->write(ctx, loc, val);
+
+	start = mono_ns();
+	err = ctx->backend->write(ctx, loc, val);
+	opstat_add(loc->ifnam, OPSTAT_WRITE, err, mono_ns() - start, 1);
+	return err;
+}
+
+static int mdio_backend_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+				   uint16_t *buf, int count)
+{
+	uint64_t start;
+	int err;
+
+	if (!opstat_enabled)
+		return ctx->backend->read_range(ctx, loc, buf, count);
+
+	start = mono_ns();
+	err = ctx->backend->read_range(ctx, loc, buf, count);
+	opstat_add(loc->ifnam, OPSTAT_READ, err, mono_ns() - start, count);
+	return err;
+}
+
+static int mdio_page_get(struct mdio_ctx *ctx, const struct loc *raw,
+			 struct mdio_page **pgp)
+{
+	struct loc loc_page = *raw;
+	struct mdio_page *pg;
+	uint16_t val;
+	int err;
+
+	pg = mdio_page_find(ctx, raw);
+	if (pg)
+		goto out;
+
+	loc_page.reg = PAGE_REG;
+	err = mdio_backend_read(ctx, &loc_page, &val);
+	if (err)
+		return err;
+
+	pg = calloc(1, sizeof(*pg));
+	if (!pg)
+		return -ENOMEM;
+
+	memcpy(pg->ifnam, raw->ifnam, IFNAMSIZ);
+	pg->phy_id = raw->phy_id;
+	pg->orig = pg->cur = val;
+
+	/* bus workers on different interfaces may add theirs at once */
+	pg->next = __atomic_load_n(&ctx->pages, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&ctx->pages, &pg->next, pg, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+out:
+	*pgp = pg;
+	return 0;
+}
+
+static int mdio_page_set(struct mdio_ctx *ctx, const struct loc *raw,
+			 struct mdio_page *pg, uint16_t page)
+{
+	struct loc loc_page = *raw;
+	int err;
+
+	if (pg->cur == page)
+		return 0;
+
+	loc_page.reg = PAGE_REG;
+	err = mdio_backend_write(ctx, &loc_page, page);
+	if (err)
+		return err;
+
+	pg->cur = page;
+	return 0;
+}
+
+/* Turn LOC into the plain C22 location RAW that the backends see, and
+ * make sure the PHY has the right page selected for it. Paged accesses
+ * only touch the page register when the page actually changes, plain
+ * ones put back the original page first. */
+static int mdio_page_select(struct mdio_ctx *ctx, const struct loc *loc,
+			    struct loc *raw, struct mdio_page **pgp)
+{
+	struct mdio_page *pg;
+	int err;
+
+	*raw = *loc;
+	raw->page = 0;
+	raw->flags = 0;
+	*pgp = NULL;
+
+	if (loc_is_paged(loc)) {
+		err = mdio_page_get(ctx, raw, &pg);
+		if (err)
+			return err;
+
+		*pgp = pg;
+		return mdio_page_set(ctx, raw, pg, loc->page);
+	}
+
+	if (!__atomic_load_n(&ctx->pages, __ATOMIC_RELAXED))
+		return 0;
+
+	pg = mdio_page_find(ctx, raw);
+	if (!pg)
+		return 0;
+
+	*pgp = pg;
+	return mdio_page_set(ctx, raw, pg, pg->orig);
+}
+
+/* Point the MMD access registers of the C22 PHY at the C45 register in
+ * LOC, leaving RAW on the data register. FUNC picks what accesses to
+ * it do, MII_MMD_CTRL_INCR_RDWT steps the address after each one. */
+static int mdio_mmd_setup(struct mdio_ctx *ctx, const struct loc *loc,
+			  struct loc *raw, uint16_t func)
+{
+	uint16_t dev = loc_c45_dev(loc);
+	int err;
+
+	memset(raw, 0, sizeof(*raw));
+	memcpy(raw->ifnam, loc->ifnam, IFNAMSIZ);
+	raw->phy_id = loc_c45_port(loc);
+
+	raw->reg = MII_MMD_CTRL;
+	err = mdio_ctx_write(ctx, raw, MII_MMD_CTRL_ADDR | dev);
+	if (err)
+		return err;
+
+	raw->reg = MII_MMD_DATA;
+	err = mdio_ctx_write(ctx, raw, loc->reg);
+	if (err)
+		return err;
+
+	raw->reg = MII_MMD_CTRL;
+	err = mdio_ctx_write(ctx, raw, func | dev);
+	if (err)
+		return err;
+
+	raw->reg = MII_MMD_DATA;
+	return 0;
+}
+
+static struct mdio_backend *backends[] = {
+	&ioctl_backend,
+	&sim_backend,
+	&replay_backend,
+
+	NULL
+};
+
+/* The context everything but library users goes through */
+static struct mdio_ctx mdio_default = {
+	.backend = &ioctl_backend,
+	.sd = -1,
+};
+
+static int mdio_ctx_select(struct mdio_ctx *ctx, const char *spec)
+{
+	struct mdio_backend **b;
+	const char *arg;
+	size_t len;
+
+	arg = strchr(spec, ':');
+	len = arg ? (size_t)(arg++ - spec) : strlen(spec);
+
+	for (b = backends; *b; b++) {
+		if (strlen((*b)->name) != len || strncmp((*b)->name, spec, len))
+			continue;
+
+		if ((*b)->open) {
+			int err = (*b)->open(arg);
+
+			if (err)
+				return err;
+		} else if (arg) {
+			return -EINVAL;
+		}
+
+		ctx->backend = *b;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+int mdio_ctx_init(struct mdio_ctx *ctx, const char *spec)
+{
+	ctx->backend = &ioctl_backend;
+	ctx->sd = -1;
+	ctx->pages = NULL;
+	ctx->smi_hold = 0;
+
+	return spec ? mdio_ctx_select(ctx, spec) : 0;
+}
+
+/* Put back the page of every PHY on IFNAM, or on all interfaces if
+ * NULL, that was switched by a paged access. */
+int mdio_ctx_restore(struct mdio_ctx *ctx, const char *ifnam)
+{
+	struct mdio_page *pg;
+	struct loc raw;
+	int err, first = 0;
+
+	for (pg = __atomic_load_n(&ctx->pages, __ATOMIC_ACQUIRE); pg;
+	     pg = pg->next) {
+		if (ifnam && strncmp(pg->ifnam, ifnam, IFNAMSIZ))
+			continue;
+
+		memset(&raw, 0, sizeof(raw));
+		memcpy(raw.ifnam, pg->ifnam, IFNAMSIZ);
+		raw.phy_id = pg->phy_id;
+
+		err = mdio_page_set(ctx, &raw, pg, pg->orig);
+		first = first ? : err;
+	}
+
+	return first;
+}
+
+void mdio_ctx_close(struct mdio_ctx *ctx)
+{
+	struct mdio_page *pg, *next;
+
+	mdio_ctx_restore(ctx, NULL);
+
+	for (pg = ctx->pages; pg; pg = next) {
+		next = pg->next;
+		free(pg);
+	}
+
+	ctx->pages = NULL;
+
+	if (ctx->sd >= 0)
+		close(ctx->sd);
+
+	ctx->sd = -1;
+}
+
+int mdio_ctx_read(struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val)
+{
+	struct mdio_page *pg;
+	struct loc raw;
+	int err;
+
+	if (loc_is_smi(loc))
+		return smi_read(ctx, loc, val);
+
+	if (loc_is_mmd(loc)) {
+		err = mdio_mmd_setup(ctx, loc, &raw, MII_MMD_CTRL_NOINCR);
+		return err ? : mdio_ctx_read(ctx, &raw, val);
+	}
+
+	err = mdio_page_select(ctx, loc, &raw, &pg);
+	if (err)
+		return err;
+
+	return mdio_backend_read(ctx, &raw, val);
+}
+
+int mdio_ctx_write(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val)
+{
+	struct mdio_page *pg;
+	struct loc raw;
+	int err;
+
+	if (loc_is_smi(loc))
+		return smi_write(ctx, loc, val);
+
+	if (loc_is_mmd(loc)) {
+		err = mdio_mmd_setup(ctx, loc, &raw, MII_MMD_CTRL_NOINCR);
+		return err ? : mdio_ctx_write(ctx, &raw, val);
+	}
+
+	err = mdio_page_select(ctx, loc, &raw, &pg);
+	if (err)
+		return err;
+
+	err = mdio_backend_write(ctx, &raw, val);
+	if (err || !pg || raw.reg != PAGE_REG)
+		return err;
+
+	/* the page was changed behind our back, an explicit write to
+	 * it from a plain location is also the one to go back to */
+	pg->cur = val;
+	if (!loc_is_paged(loc))
+		pg->orig = val;
+
+	return 0;
+}
+
+int mdio_ctx_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+			uint16_t *buf, int count)
+{
+	struct mdio_page *pg;
+	struct loc loc_reg;
+	int err, i;
+
+	if (loc_is_smi(loc))
+		return smi_read_range(ctx, loc, buf, count);
+
+	/* set up the address once and let the PHY step it, N+3
+	 * transactions instead of 4N */
+	if (loc_is_mmd(loc)) {
+		err = mdio_mmd_setup(ctx, loc, &loc_reg, MII_MMD_CTRL_INCR_RDWT);
+		for (i = 0; !err && i < count; i++)
+			err = mdio_ctx_read(ctx, &loc_reg, &buf[i]);
+
+		return err;
+	}
+
+	/* one page switch, if any, for the whole range */
+	err = mdio_page_select(ctx, loc, &loc_reg, &pg);
+	if (err)
+		return err;
+
+	if (ctx->backend->read_range)
+		return mdio_backend_read_range(ctx, &loc_reg, buf, count);
+
+	for (i = 0; i < count; i++, loc_reg.reg++) {
+		err = mdio_backend_read(ctx, &loc_reg, &buf[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+int mdio_backend_select(const char *spec)
+{
+	return mdio_ctx_select(&mdio_default, spec);
+}
+
+void mdio_exit(void)
+{
+	mdio_ctx_restore(&mdio_default, NULL);
+}
+
+int mdio_restore(const char *ifnam)
+{
+	return mdio_ctx_restore(&mdio_default, ifnam);
+}
+
+int mdio_read(const struct loc *loc, uint16_t *val)
+{
+	return mdio_ctx_read(&mdio_default, loc, val);
+}
+
+int mdio_write(const struct loc *loc, uint16_t val)
+{
+	return mdio_ctx_write(&mdio_default, loc, val);
+}
+
+int mdio_read_range(const struct loc *loc, uint16_t *buf, int count)
+{
+	return mdio_ctx_read_range(&mdio_default, loc, buf, count);
+}
+
+int mdio_ifaces(int (*cb)(const char *ifnam, void *arg), void *arg)
+{
+	return mdio_default.backend->ifaces(cb, arg);
+}
+
+int phy_read(const struct loc *loc)
+{
+	uint16_t val;
+	int err;
+
+	if (!phy_cache_lookup(loc, &val))
+		return val;
+
+	err = mdio_read(loc, &val);
+	if (err) {
+		fprintf(stderr, "error: phy_read (%d)\n", err);
+		return err;
+	}
+
+	phy_cache_store(loc, val);
+	return val;
+}
+
+int phy_write(const struct loc *loc, uint16_t val)
+{
+	int err;
+
+	/* resets, pages and indirect accesses can change any other
+	 * register, so do not try to be clever about what to keep. */
+	phy_cache_flush();
+
+	err = mdio_write(loc, val);
+
+	if (err)
+		fprintf(stderr, "error: phy_write (%d)\n", err);
+
+	return err;
+}
+
+uint32_t phy_id(const struct loc *loc)
+{
+	struct loc loc_id = *loc;
+	uint16_t id[2];
+
+	loc_id.reg = MII_PHYSID1;
+	id[0] = phy_read(&loc_id);
+
+	loc_id.reg = MII_PHYSID2;
+	id[1] = phy_read(&loc_id);
+
+	return (id[0] << 16) | id[1];
+}
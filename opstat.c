@@ -0,0 +1,285 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define OPSTAT_IFS 32
+
+/* Bucket b counts transactions that took less than 2^b ns */
+#define OPSTAT_BUCKETS 40
+
+/* Errors by errno, any beyond the last one count as it */
+#define OPSTAT_ERRNOS 160
+
+struct opstat {
+	char ifnam[IFNAMSIZ];
+
+	uint64_t ns[OPSTAT_KINDS];
+	uint64_t max[OPSTAT_KINDS];
+	uint64_t lat[OPSTAT_KINDS][OPSTAT_BUCKETS];
+	uint64_t errs[OPSTAT_ERRNOS];
+};
+
+int opstat_enabled;
+
+/* Slots are only ever added, under the lock, and published by bumping
+ * the count, so lookups walk them without it. Counters are bumped
+ * atomically as bus workers and daemon clients may share a slot. */
+static struct opstat opstats[OPSTAT_IFS];
+static unsigned opstat_count;
+
+/* Interfaces beyond the table are all counted here */
+static struct opstat opstat_other;
+static pthread_mutex_t opstat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *opstat_kind_str[OPSTAT_KINDS] = {
+	[OPSTAT_READ]  = "read",
+	[OPSTAT_WRITE] = "write",
+};
+
+static struct opstat *opstat_get(const char *ifnam)
+{
+	unsigned i, n = __atomic_load_n(&opstat_count, __ATOMIC_ACQUIRE);
+	struct opstat *os = &opstat_other;
+
+	for (i = 0; i < n; i++) {
+		if (!strncmp(opstats[i].ifnam, ifnam, IFNAMSIZ))
+			return &opstats[i];
+	}
+
+	if (n == OPSTAT_IFS)
+		return os;
+
+	pthread_mutex_lock(&opstat_lock);
+
+	/* someone else may have added it since */
+	for (i = 0; i < opstat_count; i++) {
+		if (!strncmp(opstats[i].ifnam, ifnam, IFNAMSIZ)) {
+			os = &opstats[i];
+			goto out;
+		}
+	}
+
+	if (opstat_count < OPSTAT_IFS) {
+		os = &opstats[opstat_count];
+		strncpy(os->ifnam, ifnam, IFNAMSIZ - 1);
+		__atomic_store_n(&opstat_count, opstat_count + 1,
+				 __ATOMIC_RELEASE);
+	}
+out:
+	pthread_mutex_unlock(&opstat_lock);
+	return os;
+}
+
+static int opstat_bucket(uint64_t ns)
+{
+	int b = ns ? 64 - __builtin_clzll(ns) : 0;
+
+	return b < OPSTAT_BUCKETS ? b : OPSTAT_BUCKETS - 1;
+}
+
+/* COUNT registers moved by one backend call of NS, as for a range
+ * read, are counted as that many transactions of the average time. */
+void opstat_add(const char *ifnam, int kind, int err, uint64_t ns, int count)
+{
+	struct opstat *os = opstat_get(ifnam);
+	uint64_t max;
+	int e;
+
+	if (!os || count < 1)
+		return;
+
+	ns /= count;
+
+	__atomic_fetch_add(&os->ns[kind], ns * count, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&os->lat[kind][opstat_bucket(ns)], count,
+			   __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&os->max[kind], __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&os->max[kind], &max, ns, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	if (!err)
+		return;
+
+	e = (-err < OPSTAT_ERRNOS) ? -err : OPSTAT_ERRNOS - 1;
+	__atomic_fetch_add(&os->errs[e], 1, __ATOMIC_RELAXED);
+}
+
+static void opstat_ns_str(uint64_t ns, char *str, size_t size)
+{
+	if (ns < 1000)
+		snprintf(str, size, "%lluns", (unsigned long long)ns);
+	else if (ns < 1000000)
+		snprintf(str, size, "%.0fus", ns / 1e3);
+	else if (ns < 1000000000)
+		snprintf(str, size, "%.0fms", ns / 1e6);
+	else
+		snprintf(str, size, "%.0fs", ns / 1e9);
+}
+
+/* upper bound of the bucket holding the PCT:th percentile */
+static uint64_t opstat_pct(const uint64_t *lat, uint64_t ops, int pct)
+{
+	uint64_t seen = 0, rank = (ops * pct + 99) / 100;
+	int b;
+
+	for (b = 0; b < OPSTAT_BUCKETS - 1; b++) {
+		seen += lat[b];
+		if (seen >= rank)
+			break;
+	}
+
+	return 1ULL << b;
+}
+
+static void opstat_dump_kind(const struct opstat *os, int kind)
+{
+	uint64_t lat[OPSTAT_BUCKETS], ops = 0;
+	char p50[16], p99[16], max[16], le[16];
+	int b;
+
+	for (b = 0; b < OPSTAT_BUCKETS; b++) {
+		lat[b] = __atomic_load_n(&os->lat[kind][b], __ATOMIC_RELAXED);
+		ops += lat[b];
+	}
+
+	if (!ops)
+		return;
+
+	opstat_ns_str(opstat_pct(lat, ops, 50), p50, sizeof(p50));
+	opstat_ns_str(opstat_pct(lat, ops, 99), p99, sizeof(p99));
+	opstat_ns_str(__atomic_load_n(&os->max[kind], __ATOMIC_RELAXED),
+		      max, sizeof(max));
+
+	fprintf(stderr, "%*s%-5s ops:%llu avg:%.1fus p50:<%s p99:<%s max:%s\n",
+		INDENT, "", opstat_kind_str[kind], (unsigned long long)ops,
+		__atomic_load_n(&os->ns[kind], __ATOMIC_RELAXED) / 1e3 / ops,
+		p50, p99, max);
+
+	fprintf(stderr, "%*s", 2 * INDENT, "");
+	for (b = 0; b < OPSTAT_BUCKETS; b++) {
+		if (!lat[b])
+			continue;
+
+		opstat_ns_str(1ULL << b, le, sizeof(le));
+		fprintf(stderr, " <%s:%llu", le, (unsigned long long)lat[b]);
+	}
+	fputc('\n', stderr);
+}
+
+static uint64_t opstat_ops(const struct opstat *os)
+{
+	uint64_t ops = 0;
+	int kind, b;
+
+	for (kind = 0; kind < OPSTAT_KINDS; kind++) {
+		for (b = 0; b < OPSTAT_BUCKETS; b++)
+			ops += __atomic_load_n(&os->lat[kind][b],
+					       __ATOMIC_RELAXED);
+	}
+
+	return ops;
+}
+
+static void opstat_dump_one(const struct opstat *os)
+{
+	uint64_t errs;
+	int e, kind;
+
+	for (kind = 0; kind < OPSTAT_KINDS; kind++)
+		opstat_dump_kind(os, kind);
+
+	for (e = 1; e < OPSTAT_ERRNOS; e++) {
+		errs = __atomic_load_n(&os->errs[e], __ATOMIC_RELAXED);
+		if (!errs)
+			continue;
+
+		fprintf(stderr, "%*serror %d (%s): %llu\n", INDENT, "",
+			-e, strerror(e), (unsigned long long)errs);
+	}
+}
+
+void opstat_dump(void)
+{
+	unsigned i, n = __atomic_load_n(&opstat_count, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < n; i++) {
+		fprintf(stderr, "%s:\n", opstats[i].ifnam);
+		opstat_dump_one(&opstats[i]);
+	}
+
+	if (opstat_ops(&opstat_other)) {
+		fprintf(stderr, "other interfaces, past the first %d:\n",
+			OPSTAT_IFS);
+		opstat_dump_one(&opstat_other);
+	}
+
+	fflush(stderr);
+}
+
+/* SIGUSR1 is taken by a thread of its own, so that dumps happen
+ * outside of signal context and whatever the main loop is blocked in. */
+static void *opstat_sig_thread(void *arg)
+{
+	sigset_t *set = arg;
+	int signo;
+
+	for (;;) {
+		if (!sigwait(set, &signo))
+			opstat_dump();
+	}
+
+	return NULL;
+}
+
+/* Must be called before any other thread is started, for them all to
+ * inherit SIGUSR1 being blocked. */
+int opstat_enable(void)
+{
+	static sigset_t set;
+	pthread_t tid;
+	int err;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+
+	err = pthread_sigmask(SIG_BLOCK, &set, NULL);
+	if (err)
+		return -err;
+
+	err = pthread_create(&tid, NULL, opstat_sig_thread, &set);
+	if (err)
+		return -err;
+
+	pthread_detach(tid);
+
+	opstat_enabled = 1;
+	atexit(opstat_dump);
+	return 0;
+}
@@ -16,8 +16,8 @@
 
 #define _GNU_SOURCE
 
-#include <glob.h>
 #include <errno.h>
+#include <getopt.h>
 #include <libgen.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -38,325 +38,38 @@
 
 extern char *__progname;
 
-struct applet {
-	const char *name;
-	int (*usage)(int code);
-	int (*parse_loc)(char *text, struct loc *loc, int strict);
-	int (*print)(const struct loc *loc, int indent);
-};
-
-
-static int __phy_op(const struct loc *loc, uint16_t *val, int cmd)
-{
-	static int sd = -1;
-
-	struct ifreq ifr;
-	struct mii_ioctl_data* mii = (struct mii_ioctl_data *)(&ifr.ifr_data);
-	int err;
-
-	if (sd < 0)
-		sd = socket(AF_INET, SOCK_DGRAM, 0);
-
-	if (sd < 0)
-		return sd;
-
-	strncpy(ifr.ifr_name, loc->ifnam, sizeof(ifr.ifr_name));
-
-	mii->phy_id  = loc->phy_id;
-	mii->reg_num = loc->reg;
-	mii->val_in  = *val;
-	mii->val_out = 0;
-
-	err = ioctl(sd, cmd, &ifr);
-	if (err)
-		return -errno;
-
-	*val = mii->val_out;
-	return 0;
-}
-
-int phy_read(const struct loc *loc)
-{
-	uint16_t val = 0;
-	int err = __phy_op(loc, &val, SIOCGMIIREG);
-
-	if (err) {
-		fprintf(stderr, "error: phy_read (%d)\n", err);
-		return err;
-	}
-
-	return val;
-}
-
-int phy_write(const struct loc *loc, uint16_t val)
-{
-	int err = __phy_op(loc, &val, SIOCSMIIREG);
-
-	if (err)
-		fprintf(stderr, "error: phy_write (%d)\n", err);
-
-	return err;
-}
-
-uint32_t phy_id(const struct loc *loc)
-{
-	struct loc loc_id = *loc;
-	uint16_t id[2];
-
-	loc_id.reg = MII_PHYSID1;
-	id[0] = phy_read(&loc_id);
-	
-	loc_id.reg = MII_PHYSID2;
-	id[1] = phy_read(&loc_id);
-
-	return (id[0] << 16) | id[1];
-}
-
-static int parse_phy_id(char *text, uint16_t *phy_id)
-{
-	unsigned long port, dev;
-	char *end;
-
-	port = strtoul(text, &end, 0);
-	if (!end[0]) {
-		/* simple phy address */
-		*phy_id = port;
-		return 0;
-	}
-
-	if (end[0] != ':') {
-		/* not clause 45 either */
-		return 1;
-	}
-
-	dev = strtoul(end + 1, &end, 0);
-	if (end[0])
-		return 1;
-
-	*phy_id = mdio_phy_id_c45(port, dev);
-	return 0;
-}
-
-static int sysfs_readu(const char *path, int *result)
-{
-	FILE *fp;
-	char line[24];
-
-	fp = fopen(path, "r");
-	if (!fp)
-		return -EIO;
-
-	if (!fgets(line, sizeof(line), fp)) {
-		fclose(fp);
-		return -EIO;
-	}
-
-	/* limit to base ten here, output is zero padded */
-	*result = strtol(line, NULL, 10);
-	fclose(fp);
-	return (*result >= 0) ? 0 : -EINVAL;
-}
-
-static int parse_switch_id(const char *dev, int *swid, char *ifnam)
-{
-	glob_t paths;
-	char *src;
-	int cmp, err, i;
-
-	*swid = strtol(dev, NULL, 0);
-	if (*swid < 0)
-		return -EINVAL;
-
-	err = glob("/sys/class/net/*/phys_switch_id", 0, NULL, &paths);
-	if (err)
-		return -ENOENT;
-
-	err = -ENOENT;
-	for (i = 0; i < (int)paths.gl_pathc; i++) {
-		err = sysfs_readu(paths.gl_pathv[i], &cmp);
-		if (err)
-			continue;
-
-		if (cmp == *swid) {
-			err = 0;
-			break;
-		}
-	}
-
-	if (!err) {
-		src = &paths.gl_pathv[i][strlen("/sys/class/net/")];
-		strncpy(ifnam, src, IFNAMSIZ - 1);
-		strtok(ifnam, "/");
-	}
-
-	globfree(&paths);
-	return err;
-}
-
-static int parse_switch_addr(const char *addr, int *swaddr)
-{
-	const char *num;
-	int offs;
-
-	if (strstr(addr, "phy") == addr) {
-		num = &addr[3];
-		offs = 0x0;
-	} else if (strstr(addr, "port") == addr) {
-		num = &addr[4];
-		offs = 0x10;
-	} else if (!strcmp(addr, "serdes")) {
-		*swaddr = 0xf;
-		return 0;
-	} else if (strstr(addr, "global") == addr) {
-		num = &addr[6];
-		offs = 0x1a;
-	} else {
-		num = addr;
-		offs = 0x0;
-	}
-
-	*swaddr = strtol(num, NULL, 0);
-	if (*swaddr < 0)
-		return -EINVAL;
-
-	*swaddr += offs;
-	return 0;
-}
-
-static int loc_segments(char *text, char **a, char **b, char **c)
-{
-	*a = strtok(text, "/");
-	if (!*a)
-		return 0;
-
-	*b = strtok(NULL, "/");
-	if (!*b)
-		return 1;
-
-	*c = strtok(NULL, "/");
-	if (!*c)
-		return 2;
-
-	return 3;
-}
-
-static int phytool_parse_loc_segs(char *dev, char *addr, char *reg,
-				  struct loc *loc)
-{
-	int err;
-
-	strncpy(loc->ifnam, dev, IFNAMSIZ - 1);
-
-	err = parse_phy_id(addr, &loc->phy_id);
-	if (err)
-		return err;
-
-	loc->reg = reg ? strtoul(reg, NULL, 0) : REG_SUMMARY;
-	return 0;
-}
-
-static int phytool_parse_loc(char *text, struct loc *loc, int strict)
-{
-	char *dev = NULL, *addr = NULL, *reg = NULL;
-	int segs;
-
-	segs = loc_segments(text, &dev, &addr, &reg);
-	if (segs < (strict ? 3 : 2))
-		return -EINVAL;
-
-	return phytool_parse_loc_segs(dev, addr, reg, loc);
-}
-
-static int mv6tool_parse_loc_if(char *dev, char *addr, char *reg,
-				struct loc *loc)
-{
-	char *path;
-	int err, phy_port, phy_dev;
-
-	strncpy(loc->ifnam, dev, IFNAMSIZ - 1);
-
-	err = asprintf(&path, "/sys/class/net/%s/phys_switch_id", dev);
-	if (err == -1)
-		return -ENOMEM;
-
-	err = sysfs_readu(path, &phy_port);
-	free(path);
-	if (err)
-		return -ENOSYS;
-
-	err = asprintf(&path, "/sys/class/net/%s/phys_port_id", dev);
-	if (err == -1)
-		return -ENOMEM;
-
-	err = sysfs_readu(path, &phy_dev);
-	free(path);
-	if (err)
-		return -ENOSYS;
-
-	if (!addr || !strcmp(addr, "port"))
-		phy_dev += 0x10;
-	else if (!strcmp(addr, "phy"))
-		phy_dev += 0;
-	else
-		return -EINVAL;
-
-	loc->phy_id = mdio_phy_id_c45(phy_port, phy_dev);
-	loc->reg = reg ? strtoul(reg, NULL, 0) : REG_SUMMARY;
-	return 0;
-}
-
-static int mv6tool_parse_loc(char *text, struct loc *loc, int strict)
-{
-	char *dev = NULL, *addr = NULL, *reg = NULL;
-	int phy_port, phy_dev;
-	int err, segs;
-
-	segs = loc_segments(text, &dev, &addr, &reg);
-	if (segs < (strict ? 3 : 1))
-		return -EINVAL;
-
-	if (if_nametoindex(dev)) {
-		err = mv6tool_parse_loc_if(dev, addr, reg, loc);
-		if (!err)
-			return 0;
-	}
-
-	if (segs < (strict ? 3 : 2))
-		return -EINVAL;
-
-	err = parse_switch_id(dev, &phy_port, loc->ifnam);
-	if (err)
-		goto fallback;
-
-	err = parse_switch_addr(addr, &phy_dev);
-	if (err)
-		goto fallback;
-
-	loc->phy_id = mdio_phy_id_c45(phy_port, phy_dev);
-	loc->reg = reg ? strtoul(reg, NULL, 0) : REG_SUMMARY;
-	return 0;
-fallback:
-	return phytool_parse_loc_segs(dev, addr, reg, loc);
-}
-
 static int phytool_read(struct applet *a, int argc, char **argv)
 {
 	struct loc loc;
-	int val;
+	int count, val;
 
 	if (!argc)
 		return 1;
 
-	if (a->parse_loc(argv[0], &loc, 1)) {
+	if (parse_loc_range(a, argv[0], &loc, &count, 1)) {
 		fprintf(stderr, "error: bad location format\n");
 		return 1;
 	}
 
+	if (count > 1)
+		return dump_range(&loc, count, 0) ? 1 : 0;
+
 	val = phy_read (&loc);
 	if (val < 0)
 		return 1;
 
-	printf("0x%.4x\n", val);
+	if (emit_fmt == EMIT_TEXT) {
+		printf("0x%.4x\n", val);
+		return 0;
+	}
+
+	emit_begin();
+	emit_loc("loc", &loc);
+	if (loc_is_paged(&loc))
+		emit_uint("page", loc.page);
+	emit_uint("reg", loc.reg);
+	emit_uint("val", val);
+	emit_end();
 	return 0;
 }
 
@@ -396,27 +109,117 @@ static int phytool_print(struct applet *a, int argc, char **argv)
 		return 1;
 	}
 
+	/* summaries read IDs more than once, only hit the bus once */
+	phy_cache_begin();
 	err = a->print(&loc, 0);
+	phy_cache_end();
 	if (err)
 		return 1;
 	
 	return 0;
 }
 
+static int phytool_batch_line(struct applet *a, char *line)
+{
+	char *argv[8];
+	int argc = 0;
+
+	/* split all tokens up front, parse_loc() relies on strtok too */
+	for (argv[argc] = strtok(line, " \t\r\n"); argv[argc];
+	     argv[argc] = strtok(NULL, " \t\r\n")) {
+		if (argv[argc][0] == '#')
+			break;
+
+		if (++argc == (int)(sizeof(argv) / sizeof(argv[0])))
+			return 1;
+	}
+
+	if (!argc)
+		return 0;
+
+	if (!strcmp(argv[0], "read"))
+		return phytool_read(a, argc - 1, &argv[1]);
+	else if (!strcmp(argv[0], "write"))
+		return phytool_write(a, argc - 1, &argv[1]);
+	else if (!strcmp(argv[0], "print"))
+		return phytool_print(a, argc - 1, &argv[1]);
+
+	fprintf(stderr, "error: unknown command \"%s\"\n", argv[0]);
+	return 1;
+}
+
+static int phytool_batch(struct applet *a, int argc, char **argv)
+{
+	FILE *fp = stdin;
+	char *line = NULL;
+	size_t len = 0;
+	int lineno = 0, err = 0;
+
+	if (argc && strcmp(argv[0], "-")) {
+		fp = fopen(argv[0], "r");
+		if (!fp) {
+			fprintf(stderr, "error: unable to open %s (%d)\n",
+				argv[0], -errno);
+			return 1;
+		}
+	}
+
+	phy_cache_begin();
+	while (getline(&line, &len, fp) > 0) {
+		lineno++;
+
+		if (phytool_batch_line(a, line)) {
+			fprintf(stderr, "error: batch line %d failed\n", lineno);
+			err = 1;
+		}
+
+		/* whoever feeds stdin may be waiting for the answer */
+		if (fp == stdin)
+			fflush(stdout);
+	}
+
+	phy_cache_end();
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	return err;
+}
+
 static int phytool_usage(int code)
 {
-	printf("Usage: %s read  IFACE/ADDR/REG\n"
+	printf("Usage: %s read  IFACE/ADDR/REG[-END]\n"
 	       "       %s write IFACE/ADDR/REG <0-0xffff>\n"
 	       "       %s print IFACE/ADDR[/REG]\n"
+	       "       %s batch [FILE]\n"
+	       "       %s bench [-w] [-n COUNT] IFACE/ADDR[/REG]...\n"
+	       "       %s aneg-bench [-r] [-n COUNT] [-t TIMEOUT] IFACE/ADDR\n"
+	       "       %s scan  [c22|c45] [IFACE...]\n"
+	       "       %s dump  [-b] IFACE/ADDR[/REG[-END]]...\n"
+	       "       %s snapshot save FILE IFACE/ADDR[/REG[-END]]...\n"
+	       "       %s snapshot diff FILE FILE\n"
+	       "       %s decode [-a] [-l IFACE/ADDR/REG] [-j JOBS] FILE...\n"
+	       "       %s watch [-i INTERVAL] [-n COUNT] IFACE/ADDR[/REG[-END]]...\n"
+	       "       %s linkmon [-i INTERVAL] [-d DURATION] IFACE/ADDR...\n"
+	       "       %s publish [-i INTERVAL] [-s NAME] IFACE/ADDR[/REG[-END]]...\n"
+	       "       %s peek [-s NAME]\n"
+	       "       %s wait IFACE/ADDR/REG MASK VALUE [TIMEOUT]\n"
+	       "\n"
+	       "Options:\n"
+	       "  -b, --backend=BACKEND  MDIO backend, ioctl (default) or sim[:IMAGE]\n"
+	       "  -f, --format=FORMAT    Output format, text (default), json or csv\n"
+	       "  -S, --stats            Dump MDIO stats at exit and on SIGUSR1\n"
 	       "\n"
 	       "Clause 22:\n"
 	       "\n"
 	       "ADDR := <0-0x1f>\n"
-	       "REG  := <0-0x1f>\n"
+	       "REG  := [PAGE.]<0-0x1f>\n"
+	       "PAGE := <0-0xff>\n"
 	       "\n"
 	       "Clause 45 (not supported by all MDIO drivers):\n"
 	       "\n"
-	       "ADDR := PORT:DEV\n"
+	       "ADDR := PORT:DEV | PORT:mmdDEV\n"
 	       "PORT := <0-0x1f>\n"
 	       "DEV  := <0-0x1f>\n"
 	       "REG  := <0-0xffff>\n"
@@ -431,26 +234,141 @@ static int phytool_usage(int code)
 	       "using the `print` command, the register is optional. If left out, the\n"
 	       "most common registers will be shown.\n"
 	       "\n"
+	       "PAGE.REG addresses REG on a page of a Marvell PHY, selected through\n"
+	       "register 22. The page is only written when it changes, and the one\n"
+	       "the PHY was on is put back on exit.\n"
+	       "\n"
+	       "PORT:mmdDEV reaches the MMD through registers 13/14 of the C22 PHY at\n"
+	       "PORT, for drivers that reject C45 addresses. Ranges let the PHY step\n"
+	       "the address, costing N+3 transactions for N registers.\n"
+	       "\n"
+	       "With -f json or csv, `read`, `print`, `dump`, `scan` and `decode`\n"
+	       "emit records instead: one JSON object per line, or CSV rows under a\n"
+	       "header that is repeated when the columns change. Decoded registers\n"
+	       "get a member per field, named after it, or a CSV row per field.\n"
+	       "Output that is not a terminal has no escapes, and is fully buffered\n"
+	       "for one-shot commands. Those that run on, like `watch` or `batch`,\n"
+	       "show their output as it comes.\n"
+	       "\n"
+	       "The `batch` command reads `read`, `write` and `print` commands, one\n"
+	       "per line, from FILE or stdin and runs them in order in one process.\n"
+	       "Registers without latched or self-clearing bits are only read from\n"
+	       "the bus once per batch, until the next write.\n"
+	       "\n"
+	       "Given a register range, `read` dumps it like `dump` does. The `dump`\n"
+	       "command reads each range, or all 32 registers if left out, and prints\n"
+	       "rows of `LOCATION/REG VAL...`, usable as a sim IMAGE. With -b, the\n"
+	       "raw little-endian values are written instead.\n"
+	       "\n"
+	       "The `snapshot save` command captures the registers of each location\n"
+	       "(all 32 if left out) to a binary FILE, along with the PHY ID. The\n"
+	       "`snapshot diff` command decodes every register that differs.\n"
+	       "\n"
+	       "The `decode` command replays each FILE, a dump or a snapshot, through\n"
+	       "`print` without touching the bus, spreading the files over JOBS\n"
+	       "(default: all CPUs) processes. With -a, every captured register is\n"
+	       "decoded instead. FILE may also hold `read` output, whose bare values\n"
+	       "are loaded on from the location given with -l, or on a line of its\n"
+	       "own before them. Other commands can use `-b replay:FILE` to run\n"
+	       "against the registers captured in FILE.\n"
+	       "\n"
+	       "The `watch` command reads the registers (all 32 if left out) every\n"
+	       "INTERVAL (seconds, or suffixed ns/us/ms, default 1s) and prints the\n"
+	       "ones that changed with a monotonic timestamp. On exit, the cost of a\n"
+	       "polling cycle is reported.\n"
+	       "\n"
+	       "The `linkmon` command samples the link status of each PHY every\n"
+	       "INTERVAL (default 1ms) for DURATION, or until interrupted, and logs\n"
+	       "every transition with a monotonic timestamp. A latched-low link bit\n"
+	       "is read twice, so drops shorter than INTERVAL are still reported.\n"
+	       "\n"
+	       "The `publish` command reads the registers (all 32 if left out) every\n"
+	       "INTERVAL (default 1s) into the shared memory segment NAME (default\n"
+	       "/phytool), where any number of readers can get them without a\n"
+	       "system call, see libphytool.h. The `peek` command decodes them.\n"
+	       "\n"
+	       "The `wait` command reads the register until its MASK bits equal\n"
+	       "VALUE, or for TIMEOUT (default 5s), and prints the value and how long\n"
+	       "it took. The first reads are back to back, then the gap grows with\n"
+	       "the time waited, so it is never more than about 1/8 of it late.\n"
+	       "\n"
+	       "The sim backend serves registers from IMAGE, or from a built-in PHY\n"
+	       "(sim0/0) and mv88e6352 switch (sim1/0:0x10-0x16) if left out. Each\n"
+	       "IMAGE line is `IFACE/ADDR/REG VAL...`, loading consecutive registers,\n"
+	       "`latency NSEC` to set the cost of every transaction, or\n"
+	       "`flap IFACE/ADDR/REG MASK PERIOD DOWN` to clear MASK for the first\n"
+	       "DOWN ns of every PERIOD, or `aneg IFACE/ADDR ANEG LINK [JITTER]` for\n"
+	       "aneg to complete ANEG ns, and the link to come up LINK ns, after an\n"
+	       "aneg restart or reset, plus up to JITTER ns.\n"
+	       "\n"
+	       "The `bench` command times COUNT (default 10000) reads of each\n"
+	       "register, and writes of its current value with -w, reporting ops/s\n"
+	       "and p50/p99/p999 latency. Locations without a register time the\n"
+	       "`print` summary instead.\n"
+	       "\n"
+	       "The `aneg-bench` command restarts aneg, or resets the PHY with -r,\n"
+	       "COUNT (default 10) times and reads BMSR back to back until aneg is\n"
+	       "complete and the link is up, each within TIMEOUT (default 10s).\n"
+	       "The min/p50/p99/max time to both is reported, along with the speed\n"
+	       "in BMCR.\n"
+	       "\n"
+	       "With --stats, every transaction on the bus is counted per interface,\n"
+	       "with its time in power-of-two buckets and its errors by errno, and\n"
+	       "the counts are written to stderr at exit, and on SIGUSR1 from long\n"
+	       "running commands such as `watch` or `stats`.\n"
+	       "\n"
+	       "The `scan` command probes the PHY ID of all C22 addresses on each\n"
+	       "IFACE, or on every interface, scanning separate buses in parallel.\n"
+	       "With c45, the devices in package of each port are read and only the\n"
+	       "MMDs present are visited. Interfaces on the same MDIO bus, by their\n"
+	       "PHY device or switch, are scanned one after the other, and only the\n"
+	       "first of them when scanning every interface.\n"
+	       "\n"
 	       "Bug report address: https://github.com/wkz/phytool/issues\n"
 	       "\n",
-	       __progname, __progname, __progname, __progname, __progname, __progname);
+	       __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname);
 	return code;
 }
 
 static int mv6tool_usage(int code)
 {
-	printf("Usage: %s read  LOCATION/REG\n"
+	printf("Usage: %s read  LOCATION/REG[-END]\n"
 	       "       %s write LOCATION/REG <0-0xffff>\n"
 	       "       %s print LOCATION[/REG]\n"
 	       "       %s print IFACE\n"
+	       "       %s batch [FILE]\n"
+	       "       %s bench [-w] [-n COUNT] LOCATION[/REG]...\n"
+	       "       %s aneg-bench [-r] [-n COUNT] [-t TIMEOUT] LOCATION\n"
+	       "       %s dump  [-b] LOCATION[/REG[-END]]...\n"
+	       "       %s snapshot save FILE LOCATION[/REG[-END]|/all]...\n"
+	       "       %s snapshot diff FILE FILE\n"
+	       "       %s decode [-a] [-l LOCATION/REG] [-j JOBS] FILE...\n"
+	       "       %s watch [-i INTERVAL] [-n COUNT] LOCATION[/REG[-END]]...\n"
+	       "       %s linkmon [-i INTERVAL] [-d DURATION] LOCATION...\n"
+	       "       %s publish [-i INTERVAL] [-s NAME] LOCATION[/REG[-END]]...\n"
+	       "       %s peek [-s NAME]\n"
+	       "       %s wait LOCATION/REG MASK VALUE [TIMEOUT]\n"
+	       "       %s atu dump DEV [fid FID] [port N]\n"
+	       "       %s stats [-i INTERVAL] [-n COUNT] DEV\n"
+	       "\n"
+	       "Options:\n"
+	       "  -b, --backend=BACKEND  MDIO backend, ioctl (default) or sim[:IMAGE]\n"
+	       "  -f, --format=FORMAT    Output format, text (default), json or csv\n"
+	       "  -S, --stats            Dump MDIO stats at exit and on SIGUSR1\n"
+	       "  -t, --topo-cache=FILE  Keep the switch port index in FILE across runs\n"
+	       "\n"
 	       "where\n"
 	       "\n"
-	       "LOCATION := IFACE/<port|phy> | DEV/<ADDR|phyN|portN|globalG|serdes>\n"
+	       "LOCATION := IFACE/<port|phy|smi> | DEV/<ADDR|phyN|smiN|portN|globalG|serdes>\n"
 	       "\n"
 	       "DEV  := <0-0x1f>\n"
 	       "ADDR := <0-0x1f>\n"
 	       "N    := <0-0xa>\n"
 	       "G    := <0-2>\n"
+	       "FID  := <0-0xfff>\n"
 	       "REG  := <0-0x1f>\n"
 	       "\n"
 	       "Examples:\n"
@@ -461,11 +379,148 @@ static int mv6tool_usage(int code)
 	       "The `read` and `write` commands are simple register level\n"
 	       "accessors. The `print` command will pretty-print a register. When\n"
 	       "using the `print` command, the register is optional. If left out, the\n"
-	       "most common registers will be shown.\n"
+	       "most common registers will be shown. Its heading names the device as\n"
+	       "phy:N, serdes, port:N or global:1-3; releases up to 2 showed the globals\n"
+	       "as port:11-13.\n"
+	       "\n"
+	       "The `smi` addresses reach the same internal PHYs as `phy`, through the\n"
+	       "Global2 SMI PHY command unit instead of directly, which also works in\n"
+	       "multi-chip mode. The busy bit is first polled after the time the unit\n"
+	       "took for previous commands, so it is usually polled only once.\n"
+	       "\n"
+	       "The `atu dump` command walks the address database of switch DEV, or\n"
+	       "of the switch of a LOCATION, with the ATU GetNext operation, and\n"
+	       "prints each entry as it is read. Without fid, every FID is walked,\n"
+	       "costing four transactions for each empty one. With port, only the\n"
+	       "entries whose port vector includes port N are printed.\n"
+	       "\n"
+	       "The `stats` command captures the RMON counters of every port of\n"
+	       "switch DEV, or of the switch of a LOCATION, every INTERVAL (default\n"
+	       "1s), and prints the ones that changed with their delta and rate.\n"
+	       "Each counter costs a stats op and, usually, a single poll that also\n"
+	       "reads it back, so a pass over an mv88e6352 is about 900 transactions.\n"
+	       "\n"
+	       "With -f json or csv, `read`, `print`, `dump`, `scan` and `decode`\n"
+	       "emit records instead: one JSON object per line, or CSV rows under a\n"
+	       "header that is repeated when the columns change. Decoded registers\n"
+	       "get a member per field, named after it, or a CSV row per field.\n"
+	       "Output that is not a terminal has no escapes, and is fully buffered\n"
+	       "for one-shot commands. Those that run on, like `watch` or `batch`,\n"
+	       "show their output as it comes.\n"
+	       "\n"
+	       "The `batch` command reads `read`, `write` and `print` commands, one\n"
+	       "per line, from FILE or stdin and runs them in order in one process.\n"
+	       "Registers without latched or self-clearing bits are only read from\n"
+	       "the bus once per batch, until the next write.\n"
+	       "\n"
+	       "Given a register range, `read` dumps it like `dump` does. The `dump`\n"
+	       "command reads each range, or all 32 registers if left out, and prints\n"
+	       "rows of `LOCATION/REG VAL...`, usable as a sim IMAGE. With -b, the\n"
+	       "raw little-endian values are written instead.\n"
+	       "\n"
+	       "The `snapshot save` command captures the registers of each location\n"
+	       "(all 32 if left out) to a binary FILE, along with the switch model.\n"
+	       "LOCATION/all captures every port, serdes and global device of the\n"
+	       "switch. The `snapshot diff` command decodes every register that\n"
+	       "differs.\n"
+	       "\n"
+	       "The `decode` command replays each FILE, a dump or a snapshot, through\n"
+	       "`print` without touching the bus, spreading the files over JOBS\n"
+	       "(default: all CPUs) processes. With -a, every captured register is\n"
+	       "decoded instead. FILE may also hold `read` output, whose bare values\n"
+	       "are loaded on from the location given with -l, or on a line of its\n"
+	       "own before them. Other commands can use `-b replay:FILE` to run\n"
+	       "against the registers captured in FILE.\n"
+	       "\n"
+	       "The `watch` command reads the registers (all 32 if left out) every\n"
+	       "INTERVAL (seconds, or suffixed ns/us/ms, default 1s) and prints the\n"
+	       "ones that changed with a monotonic timestamp. On exit, the cost of a\n"
+	       "polling cycle is reported.\n"
+	       "\n"
+	       "The `linkmon` command samples the link status of each port every\n"
+	       "INTERVAL (default 1ms) for DURATION, or until interrupted, and logs\n"
+	       "every transition with a monotonic timestamp.\n"
+	       "\n"
+	       "The `publish` command reads the registers (all 32 if left out) every\n"
+	       "INTERVAL (default 1s) into the shared memory segment NAME (default\n"
+	       "/phytool), where any number of readers can get them without a\n"
+	       "system call, see libphytool.h. The `peek` command decodes them.\n"
+	       "\n"
+	       "The `wait` command reads the register until its MASK bits equal\n"
+	       "VALUE, or for TIMEOUT (default 5s), and prints the value and how long\n"
+	       "it took. The first reads are back to back, then the gap grows with\n"
+	       "the time waited, so it is never more than about 1/8 of it late.\n"
+	       "\n"
+	       "The sim backend serves registers from IMAGE, or from a built-in PHY\n"
+	       "(sim0/0) and mv88e6352 switch (sim1/0:0x10-0x16) if left out. Each\n"
+	       "IMAGE line is `IFACE/ADDR/REG VAL...`, loading consecutive registers,\n"
+	       "`latency NSEC` to set the cost of every transaction, `smi NSEC` for\n"
+	       "how long SMI PHY, ATU and stats commands stay busy,\n"
+	       "`atu IFACE/ADDR FID MAC PORTVEC STATE` to add an ATU entry to the\n"
+	       "switch at IFACE/ADDR (PORT:0x1b),\n"
+	       "`stats IFACE/ADDR PORT RATE...` for its stats counters of PORT to\n"
+	       "count up at RATE per second, from counter 0, or\n"
+	       "`flap IFACE/ADDR/REG MASK PERIOD DOWN` to clear MASK for the first\n"
+	       "DOWN ns of every PERIOD, or `aneg IFACE/ADDR ANEG LINK [JITTER]` for\n"
+	       "aneg to complete ANEG ns, and the link to come up LINK ns, after an\n"
+	       "aneg restart or reset, plus up to JITTER ns.\n"
+	       "\n"
+	       "The `bench` command times COUNT (default 10000) reads of each\n"
+	       "register, and writes of its current value with -w, reporting ops/s\n"
+	       "and p50/p99/p999 latency. Locations without a register time the\n"
+	       "`print` summary instead.\n"
+	       "\n"
+	       "The `aneg-bench` command restarts aneg, or resets the PHY with -r,\n"
+	       "COUNT (default 10) times and reads BMSR back to back until aneg is\n"
+	       "complete and the link is up, each within TIMEOUT (default 10s).\n"
+	       "The min/p50/p99/max time to both is reported, along with the speed\n"
+	       "in BMCR.\n"
+	       "\n"
+	       "With --stats, every transaction on the bus is counted per interface,\n"
+	       "with its time in power-of-two buckets and its errors by errno, and\n"
+	       "the counts are written to stderr at exit, and on SIGUSR1 from long\n"
+	       "running commands such as `watch` or `stats`.\n"
 	       "\n"
 	       "Bug report address: https://github.com/wkz/phytool/issues\n"
 	       "\n",
-	       __progname, __progname, __progname, __progname, __progname, __progname, __progname);
+	       __progname, __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname, __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname, __progname, __progname, __progname, __progname, __progname,
+	       __progname);
+
+	return code;
+}
+
+static int phytoold_usage(int code)
+{
+	printf("Usage: %s [-b BACKEND] [-s SOCKET] [-c TTL] [-S]\n"
+	       "\n"
+	       "Options:\n"
+	       "  -b BACKEND  MDIO backend, ioctl (default) or sim[:IMAGE]\n"
+	       "  -s SOCKET   UNIX socket to serve, /run/phytoold.sock (default)\n"
+	       "  -c TTL      Reuse values read within TTL\n"
+	       "  -S          Dump MDIO stats at exit and on SIGUSR1\n"
+	       "\n"
+	       "Requests, one per line:\n"
+	       "\n"
+	       "read  IFACE/ADDR/REG[-END]...\n"
+	       "write IFACE/ADDR/REG <0-0xffff>...\n"
+	       "REQUEST; REQUEST...\n"
+	       "\n"
+	       "Each line is answered with one line holding, for every register in\n"
+	       "order, the value read, `ok` for a write, or a negative errno.\n"
+	       "Addressing is as for phytool.\n"
+	       "\n"
+	       "Every bus is served by a worker of its own, shared by the interfaces\n"
+	       "on it, which runs each line's accesses to it back to back, so paged\n"
+	       "accesses are not interleaved with other clients. Concurrent reads\n"
+	       "of the same register are done once. With -c, registers without\n"
+	       "latched or self-clearing bits are not read again for TTL (seconds,\n"
+	       "or suffixed ns/us/ms), or until the next write on the bus.\n"
+	       "\n"
+	       "Bug report address: https://github.com/wkz/phytool/issues\n"
+	       "\n",
+	       __progname);
 
 	return code;
 }
@@ -483,13 +538,44 @@ static struct applet applets[] = {
 		.parse_loc = mv6tool_parse_loc,
 		.print = print_mv6tool
 	},
+	{
+		.name = "phytoold",
+		.usage = phytoold_usage,
+		.parse_loc = phytool_parse_loc,
+		.print = print_phytool
+	},
 
 	{ .name = NULL }
 };
 
+/* Commands that keep printing as they go, or answer input as it comes */
+static int cmd_streams(const char *cmd)
+{
+	static const char *streams[] = {
+		"batch", "bench", "aneg-bench", "watch", "linkmon", "publish",
+		"wait", "stats", NULL
+	};
+	int i;
+
+	for (i = 0; streams[i]; i++) {
+		if (!strcmp(cmd, streams[i]))
+			return 1;
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
+	static struct option long_options[] = {
+		{ "backend", required_argument, NULL, 'b' },
+		{ "topo-cache", required_argument, NULL, 't' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "stats", no_argument, NULL, 'S' },
+		{ NULL, 0, NULL, 0 }
+	};
 	struct applet *a;
+	int err, opt;
 
 	for (a = applets; a->name; a++) {
 		if (!strcmp(__progname, a->name))
@@ -499,15 +585,93 @@ int main(int argc, char **argv)
 	if (!a->name)
 		a = applets;
 
+	/* takes no command, just options */
+	if (a->usage == phytoold_usage)
+		return phytool_daemon(a, argc - 1, &argv[1]);
+
+	emit_init();
+
+	while ((opt = getopt_long(argc, argv, "+b:f:St:", long_options, NULL)) > 0) {
+		switch (opt) {
+		case 'b':
+			err = mdio_backend_select(optarg);
+			if (err) {
+				fprintf(stderr, "error: unable to use backend \"%s\" (%d)\n",
+					optarg, err);
+				return 1;
+			}
+			break;
+		case 'f':
+			if (emit_format(optarg)) {
+				fprintf(stderr, "error: unknown format \"%s\"\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'S':
+			err = opstat_enable();
+			if (err) {
+				fprintf(stderr, "error: unable to enable stats (%d)\n",
+					err);
+				return 1;
+			}
+			break;
+		case 't':
+			topo_set_cache(optarg);
+			break;
+		default:
+			return a->usage(1);
+		}
+	}
+
+	/* put back any page a paged location switched to. Registered
+	 * after --stats, so that its dump runs later and counts these. */
+	atexit(mdio_exit);
+
+	/* keep argv[1] as the command, like before any options existed */
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if (argc < 2)
 		return a->usage(1);
 
+	if (!cmd_streams(argv[1]))
+		emit_bulk();
+
 	if (!strcmp(argv[1], "read"))
 		return phytool_read(a, argc - 2, &argv[2]);
 	else if (!strcmp(argv[1], "write"))
 		return phytool_write(a, argc - 2, &argv[2]);
 	else if (!strcmp(argv[1], "print"))
 		return phytool_print(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "batch"))
+		return phytool_batch(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "bench"))
+		return phytool_bench(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "scan"))
+		return phytool_scan(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "dump"))
+		return phytool_dump(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "snapshot"))
+		return phytool_snapshot(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "decode"))
+		return phytool_decode(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "watch"))
+		return phytool_watch(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "linkmon"))
+		return phytool_linkmon(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "publish"))
+		return phytool_publish(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "peek"))
+		return phytool_peek(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "wait"))
+		return phytool_wait(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "aneg-bench"))
+		return phytool_aneg_bench(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "atu") && a->print == print_mv6tool)
+		return mv6tool_atu(a, argc - 2, &argv[2]);
+	else if (!strcmp(argv[1], "stats") && a->print == print_mv6tool)
+		return mv6tool_stats(a, argc - 2, &argv[2]);
 	else
 		return phytool_print(a, argc - 1, &argv[1]);
 
@@ -21,12 +21,37 @@
 
 #define REG_SUMMARY 0xffff
 
+/* Marvell PHYs keep most registers behind a page select register */
+#define PAGE_REG 22
+
+#define LOC_F_PAGE 0x01
+#define LOC_F_MMD  0x02	/* C45 reached through C22 registers 13/14 */
+#define LOC_F_SMI  0x04	/* mv6 PHY reached through the Global2 SMI unit */
+
 struct loc {
 	char ifnam[IFNAMSIZ];
 	uint16_t phy_id;
 	uint16_t reg;
+
+	uint8_t page;
+	uint8_t flags;
 };
 
+static inline int loc_is_paged(const struct loc *loc)
+{
+	return loc->flags & LOC_F_PAGE;
+}
+
+static inline int loc_is_mmd(const struct loc *loc)
+{
+	return loc->flags & LOC_F_MMD;
+}
+
+static inline int loc_is_smi(const struct loc *loc)
+{
+	return loc->flags & LOC_F_SMI;
+}
+
 static inline int loc_is_c45(const struct loc *loc)
 {
 	return loc->phy_id & MDIO_PHY_ID_C45;
@@ -42,14 +67,309 @@ static inline int loc_c45_port(const struct loc *loc)
 	return (loc->phy_id & MDIO_PHY_ID_PRTAD) >> 5;
 }
 
+struct mdio_ctx;
+
+struct mdio_backend {
+	const char *name;
+
+	int (*open) (const char *arg);
+	int (*read) (struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val);
+	int (*write)(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val);
+
+	int (*ifaces)(int (*cb)(const char *ifnam, void *arg), void *arg);
+
+	/* optional, mdio_read_range() falls back to read() */
+	int (*read_range)(struct mdio_ctx *ctx, const struct loc *loc,
+			  uint16_t *buf, int count);
+};
+
+/* A backend, and the ioctl socket which is opened on first use. The
+ * tool itself uses a default one, libphytool hands out one per handle. */
+struct mdio_ctx {
+	struct mdio_backend *backend;
+	int sd;
+
+	/* PHYs that paged locations have been used on */
+	struct mdio_page *pages;
+
+	/* ns the SMI PHY command unit usually takes, see smi.c */
+	uint64_t smi_hold;
+};
+
+extern struct mdio_backend ioctl_backend;
+extern struct mdio_backend sim_backend;
+extern struct mdio_backend replay_backend;
+
+int  sim_set   (const struct loc *loc, uint16_t val);
+void sim_reset (void);
+int  sim_replay(const char *path, const struct loc *start);
+int  sim_regs  (int (*cb)(const struct loc *loc, uint16_t val, void *arg),
+		void *arg);
+
+uint64_t mono_ns(void);
+
+typedef int (*poll_read_fn)(void *arg, uint16_t *val);
+
+/* poll_wait() reads until (val & mask) == match, see poll.c */
+struct poll {
+	uint16_t mask;
+	uint16_t match;
+	uint64_t timeout;
+
+	/* if set, the first read is held off by *hold, learned as we go */
+	uint64_t *hold;
+
+	/* reads and ns taken by the last wait */
+	unsigned polls;
+	uint64_t ns;
+};
+
+int poll_wait(struct poll *p, poll_read_fn read, void *arg, uint16_t *val);
+
+int  mdio_ctx_init (struct mdio_ctx *ctx, const char *spec);
+void mdio_ctx_close(struct mdio_ctx *ctx);
+int  mdio_ctx_restore(struct mdio_ctx *ctx, const char *ifnam);
+int  mdio_ctx_read (struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val);
+int  mdio_ctx_write(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val);
+int  mdio_ctx_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+			 uint16_t *buf, int count);
+
+/* Global2 SMI PHY command unit of mv6 switches */
+#define SMI_G2       0x1c
+#define SMI_PHY_CMD  0x18
+#define SMI_PHY_DATA 0x19
+
+#define SMI_BUSY     0x8000
+#define SMI_MODE22   0x1000
+#define SMI_OP_WRITE 0x0400
+#define SMI_OP_READ  0x0800
+
+int smi_read (struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val);
+int smi_write(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val);
+int smi_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+		   uint16_t *buf, int count);
+
+/* Global1 ATU of mv6 switches */
+#define ATU_G1       0x1b
+#define ATU_FID      0x01
+#define ATU_OP       0x0b
+#define ATU_DATA     0x0c
+#define ATU_MAC01    0x0d
+#define ATU_MAC45    0x0f
+
+#define ATU_BUSY         0x8000
+#define ATU_OP_GET_NEXT  0x4000
+#define ATU_DATA_TRUNK   0x8000
+#define ATU_DATA_PORTVEC 0x7ff0
+#define ATU_DATA_STATE   0x000f
+#define ATU_FID_MAX      0xfff
+
+/* Global1 stats unit of mv6 switches */
+#define STATS_G1     0x1b
+#define STATS_OP     0x1d
+#define STATS_CTR_HI 0x1e
+#define STATS_CTR_LO 0x1f
+
+#define STATS_BUSY       0x8000
+#define STATS_OP_MASK    0x7000
+#define STATS_OP_READ    0x4000
+#define STATS_OP_CAPTURE 0x5000
+#define STATS_HIST_RX_TX 0x0c00
+#define STATS_COUNTERS   32
+
+/* Per-interface transaction counts, errors and latency, see opstat.c */
+enum {
+	OPSTAT_READ,
+	OPSTAT_WRITE,
+	OPSTAT_KINDS
+};
+
+extern int opstat_enabled;
+
+void opstat_add   (const char *ifnam, int kind, int err, uint64_t ns, int count);
+void opstat_dump  (void);
+int  opstat_enable(void);
+
+int mdio_backend_select(const char *spec);
+void mdio_exit(void);
+int mdio_restore(const char *ifnam);
+int mdio_read (const struct loc *loc, uint16_t *val);
+int mdio_write(const struct loc *loc, uint16_t val);
+int mdio_read_range(const struct loc *loc, uint16_t *buf, int count);
+int mdio_ifaces(int (*cb)(const char *ifnam, void *arg), void *arg);
+
+void phy_cache_begin (void);
+void phy_cache_end   (void);
+void phy_cache_flush (void);
+int  phy_cache_lookup(const struct loc *loc, uint16_t *val);
+void phy_cache_store (const struct loc *loc, uint16_t val);
+int  phy_reg_volatile(const struct loc *loc);
+
 int      phy_read (const struct loc *loc);
 int      phy_write(const struct loc *loc, uint16_t val);
 uint32_t phy_id   (const struct loc *loc);
 
+struct applet {
+	const char *name;
+	int (*usage)(int code);
+	int (*parse_loc)(char *text, struct loc *loc, int strict);
+	int (*print)(const struct loc *loc, int indent);
+};
+
+/* room for the bus key of topo_if_bus() */
+#define TOPO_BUS_LEN 64
+
+void topo_set_cache(const char *path);
+int  topo_switch_if(int swid, char *ifnam);
+int  topo_if_port(const char *ifnam, int *swid, int *port);
+void topo_if_bus (const char *ifnam, char *bus, size_t size);
+
+int phytool_parse_loc(char *text, struct loc *loc, int strict);
+int mv6tool_parse_loc(char *text, struct loc *loc, int strict);
+int parse_loc_range(struct applet *a, char *text, struct loc *loc, int *count,
+		    int strict);
+int parse_switch_loc(struct applet *a, char *text, struct loc *loc, int dev);
+int loc_str(const struct loc *loc, char *buf, size_t len);
+int loc_eq (const struct loc *a, const struct loc *b);
+
+int phytool_bench(struct applet *a, int argc, char **argv);
+int phytool_scan (struct applet *a, int argc, char **argv);
+int phytool_dump (struct applet *a, int argc, char **argv);
+int phytool_snapshot(struct applet *a, int argc, char **argv);
+int phytool_decode(struct applet *a, int argc, char **argv);
+int phytool_watch(struct applet *a, int argc, char **argv);
+int phytool_linkmon(struct applet *a, int argc, char **argv);
+int phytool_daemon(struct applet *a, int argc, char **argv);
+int phytool_publish(struct applet *a, int argc, char **argv);
+int phytool_peek(struct applet *a, int argc, char **argv);
+int phytool_wait(struct applet *a, int argc, char **argv);
+int phytool_aneg_bench(struct applet *a, int argc, char **argv);
+int mv6tool_atu(struct applet *a, int argc, char **argv);
+int mv6tool_stats(struct applet *a, int argc, char **argv);
+
+int parse_interval(const char *text, uint64_t *ns);
+
+#define SHM_DEFAULT "/phytool"
+
+struct shm_seg {
+	struct shm_hdr *hdr;
+	size_t size;
+};
+
+struct shm_val {
+	struct loc loc;
+	uint16_t val;
+	int err;
+	uint32_t gen;
+	uint64_t stamp;
+};
+
+int  shm_create (struct shm_seg *seg, const char *name, const struct loc *locs,
+		 int n, uint64_t period);
+void shm_publish(struct shm_seg *seg, int i, uint16_t val, int err,
+		 uint64_t stamp);
+int  shm_attach (struct shm_seg *seg, const char *name);
+void shm_detach (struct shm_seg *seg);
+
+int      shm_count (const struct shm_seg *seg);
+uint64_t shm_period(const struct shm_seg *seg);
+int      shm_get   (const struct shm_seg *seg, int i, struct shm_val *v);
+int      shm_find  (const struct shm_seg *seg, const struct loc *loc);
+
+int snapshot_load(const char *path);
+
+int dump_range(const struct loc *loc, int count, int binary);
+
+enum reg_kind {
+	REG_FLAGS,
+	REG_ENUM,
+	REG_HEX,
+};
+
+/* a flag bit, or an enum value, and its name */
+struct reg_bit {
+	uint16_t val;
+	const char *name;
+};
+
+struct reg_field {
+	enum reg_kind kind;
+	const char *name;
+	uint16_t mask;
+
+	const struct reg_bit *bits;
+	int nbits;
+};
+
+struct reg_desc {
+	const char *name;
+
+	const struct reg_field *fields;
+	int nfields;
+};
+
+/* Generated from regs.desc, see regs.awk */
+struct reg_table {
+	const char *prefix;
+	int summary[32];
+	struct reg_desc regs[32];
+};
+
+extern const struct reg_table reg_ieee;
+extern const struct reg_table reg_mv6_port;
+extern const struct reg_table reg_mv6_serdes;
+extern const struct reg_table reg_mv6_g1;
+extern const struct reg_table reg_mv6_g2;
+extern const struct reg_table reg_mv6_g3;
+
+struct reg_visitor {
+	void (*reg)  (void *arg, const struct reg_table *t,
+		      const struct reg_desc *rd, uint16_t reg, uint16_t val);
+	void (*field)(void *arg, const struct reg_field *f, uint16_t val);
+
+	/* optional, after the last field */
+	void (*end)  (void *arg);
+};
+
+const char *reg_field_enum(const struct reg_field *f, uint16_t val);
+unsigned    reg_field_val (const struct reg_field *f, uint16_t val);
+
+void reg_decode(const struct reg_table *t, const struct loc *loc, uint16_t val,
+		const struct reg_visitor *v, void *arg);
+void reg_print (const struct reg_table *t, const struct loc *loc,
+		uint16_t val, int indent);
+
+enum emit_format {
+	EMIT_TEXT,
+	EMIT_JSON,
+	EMIT_CSV,
+};
+
+extern enum emit_format emit_fmt;
+
+int  emit_format(const char *name);
+void emit_init  (void);
+void emit_bulk  (void);
+int  emit_color (void);
+void emit_sep   (void);
+
+void emit_begin(void);
+void emit_str  (const char *key, const char *val);
+void emit_uint (const char *key, unsigned long val);
+void emit_bool (const char *key, int on);
+void emit_loc  (const char *key, const struct loc *loc);
+void emit_end  (void);
+
 void print_attr_name(const char *name, int indent);
 void print_bool(const char *name, int on);
 
 int print_phytool(const struct loc *loc, int indent);
 int print_mv6tool(const struct loc *loc, int indent);
 
+void print_phy_reg(const struct loc *loc, uint16_t val, int indent);
+void print_mv6_reg(const struct loc *loc, uint16_t val, int indent);
+
+const char *mv6_model_str(uint16_t id);
+const struct reg_table *mv6_reg_table(const struct loc *loc);
+
 #endif	/* __PHYTOOL_H */
@@ -0,0 +1,114 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* Back to back reads before backing off */
+#define POLL_TIGHT 8
+
+/* Longest gap between reads, and the shortest one worth sleeping
+ * through rather than spinning */
+#define POLL_GAP_MAX   10000000ULL
+#define POLL_GAP_SLEEP 100000ULL
+
+static void poll_until(uint64_t end)
+{
+	struct timespec ts;
+	uint64_t now = mono_ns();
+
+	if (end <= now)
+		return;
+
+	if (end - now >= POLL_GAP_SLEEP) {
+		ts.tv_sec  = (end - now) / 1000000000;
+		ts.tv_nsec = (end - now) % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+
+	while (mono_ns() < end);
+}
+
+/* Reads until the value matches. The first reads are back to back,
+ * after which the gap grows with the time spent so far, so that a
+ * condition is never seen more than about an eighth of that late,
+ * using a number of reads that only grows with the log of the time.
+ *
+ * Units that are waited on after every command (SMI, ATU, stats) pass
+ * a hold-off, which is learned as we go: a wait that took more than
+ * one read sets it to the time it took plus some margin, one done at
+ * the first read shrinks it slowly, so that only about one command in
+ * 30 wastes a read. */
+int poll_wait(struct poll *p, poll_read_fn read, void *arg, uint16_t *val)
+{
+	uint64_t start = mono_ns(), now, gap, hold = 0;
+	uint16_t v;
+	int err;
+
+	p->polls = 0;
+
+	/* the SMI hold-off is shared by the bus workers of phytoold, any
+	 * one of their guesses will do */
+	if (p->hold)
+		hold = __atomic_load_n(p->hold, __ATOMIC_RELAXED);
+
+	poll_until(start + hold);
+
+	for (;;) {
+		err = read(arg, &v);
+		if (err)
+			return err;
+
+		p->polls++;
+		now = mono_ns();
+		p->ns = now - start;
+
+		if ((v & p->mask) == p->match)
+			break;
+
+		if (p->ns >= p->timeout) {
+			if (val)
+				*val = v;
+			return -ETIMEDOUT;
+		}
+
+		if (p->polls < POLL_TIGHT)
+			continue;
+
+		gap = p->ns / 8;
+		if (gap > POLL_GAP_MAX)
+			gap = POLL_GAP_MAX;
+		if (gap > p->timeout - p->ns)
+			gap = p->timeout - p->ns;
+
+		poll_until(now + gap);
+	}
+
+	if (p->hold && p->polls > 1)
+		__atomic_store_n(p->hold, p->ns + p->ns / 8, __ATOMIC_RELAXED);
+	else if (p->hold)
+		__atomic_store_n(p->hold, hold - hold / 256, __ATOMIC_RELAXED);
+
+	if (val)
+		*val = v;
+	return 0;
+}
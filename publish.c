@@ -0,0 +1,255 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* a run of registers, published as consecutive entries */
+struct publish_range {
+	struct loc loc;
+	int count;
+	int first;
+};
+
+struct publish {
+	struct publish_range *ranges;
+	int n;
+
+	struct loc *locs;
+	int nlocs;
+
+	uint16_t *vals;
+};
+
+static volatile sig_atomic_t publish_stop;
+
+static void publish_sig(int signo)
+{
+	(void)signo;
+	publish_stop = 1;
+}
+
+static int publish_add(struct applet *a, struct publish *p, char *text)
+{
+	struct publish_range *pr;
+	struct loc *locs;
+	int i;
+
+	pr = realloc(p->ranges, (p->n + 1) * sizeof(*pr));
+	if (!pr)
+		return -ENOMEM;
+
+	p->ranges = pr;
+	pr = &p->ranges[p->n];
+
+	if (parse_loc_range(a, text, &pr->loc, &pr->count, 0))
+		return -EINVAL;
+
+	if (pr->loc.reg == REG_SUMMARY) {
+		pr->loc.reg = 0;
+		pr->count = 32;
+	}
+
+	locs = realloc(p->locs, (p->nlocs + pr->count) * sizeof(*locs));
+	if (!locs)
+		return -ENOMEM;
+
+	p->locs = locs;
+	pr->first = p->nlocs;
+	for (i = 0; i < pr->count; i++) {
+		locs[p->nlocs] = pr->loc;
+		locs[p->nlocs++].reg += i;
+	}
+
+	p->n++;
+	return 0;
+}
+
+static void publish_cycle(struct publish *p, struct shm_seg *seg)
+{
+	struct publish_range *pr;
+	uint64_t ts;
+	int err, i, j;
+
+	for (i = 0; i < p->n; i++) {
+		pr = &p->ranges[i];
+
+		err = mdio_read_range(&pr->loc, &p->vals[pr->first], pr->count);
+		ts = mono_ns();
+
+		for (j = pr->first; j < pr->first + pr->count; j++)
+			shm_publish(seg, j, p->vals[j], err, ts);
+	}
+}
+
+int phytool_publish(struct applet *a, int argc, char **argv)
+{
+	struct publish p = { .ranges = NULL };
+	const char *name = SHM_DEFAULT;
+	uint64_t interval = 1000000000, exp;
+	struct shm_seg seg = { .hdr = NULL };
+	struct itimerspec its;
+	struct sigaction sa;
+	int err = 0, fd = -1;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-i") && argc > 1) {
+			if (parse_interval(argv[1], &interval))
+				return 1;
+		} else if (!strcmp(argv[0], "-s") && argc > 1) {
+			name = argv[1];
+		} else {
+			return 1;
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (!argc)
+		return 1;
+
+	for (; argc; argc--, argv++) {
+		err = publish_add(a, &p, argv[0]);
+		if (err) {
+			fprintf(stderr, "error: bad location format\n");
+			goto out;
+		}
+	}
+
+	p.vals = calloc(p.nlocs, sizeof(*p.vals));
+	if (!p.vals) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = shm_create(&seg, name, p.locs, p.nlocs, interval);
+	if (err) {
+		fprintf(stderr, "error: %s: unable to create (%d)\n", name, err);
+		goto out;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = publish_sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	its.it_interval.tv_sec  = interval / 1000000000;
+	its.it_interval.tv_nsec = interval % 1000000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL)) {
+		err = -errno;
+		goto out;
+	}
+
+	while (!publish_stop) {
+		publish_cycle(&p, &seg);
+
+		if (read(fd, &exp, sizeof(exp)) < 0 && errno != EINTR) {
+			err = -errno;
+			break;
+		}
+	}
+
+out:
+	/* readers still attached keep the last values */
+	if (seg.hdr) {
+		shm_detach(&seg);
+		shm_unlink(name);
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	free(p.vals);
+	free(p.locs);
+	free(p.ranges);
+	return err ? 1 : 0;
+}
+
+int phytool_peek(struct applet *a, int argc, char **argv)
+{
+	const char *name = SHM_DEFAULT;
+	struct shm_seg seg;
+	struct shm_val v;
+	uint64_t now;
+	char loc[48];
+	int err, i;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-s") && argc > 1)
+			name = argv[1];
+		else
+			return 1;
+
+		argc -= 2, argv += 2;
+	}
+
+	if (argc)
+		return 1;
+
+	err = shm_attach(&seg, name);
+	if (err) {
+		fprintf(stderr, "error: %s: unable to attach (%d)\n", name, err);
+		return 1;
+	}
+
+	now = mono_ns();
+
+	for (i = 0; i < shm_count(&seg); i++) {
+		shm_get(&seg, i, &v);
+
+		if (emit_fmt == EMIT_TEXT) {
+			loc_str(&v.loc, loc, sizeof(loc));
+			printf("%s reg:0x%.2x gen:%u age:%lluus", loc, v.loc.reg,
+			       v.gen, v.gen ? (unsigned long long)
+			       ((now - v.stamp) / 1000) : 0ULL);
+
+			if (v.err)
+				printf(" error:%d", v.err);
+			putchar('\n');
+		}
+
+		if (!v.gen)
+			continue;
+
+		if (a->print == print_mv6tool)
+			print_mv6_reg(&v.loc, v.val, INDENT);
+		else
+			print_phy_reg(&v.loc, v.val, INDENT);
+	}
+
+	shm_detach(&seg);
+	return 0;
+}
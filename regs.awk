@@ -0,0 +1,151 @@
+# This file is part of phytool
+#
+# Compiles regs.desc into constant struct reg_table definitions, see
+# the description file for the input format.
+
+function fail(msg) {
+	printf("regs.desc:%d: %s\n", NR, msg) > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+function end_field() {
+	if (!fkind)
+		return
+
+	if (!nvals)
+		fail("field " fname " is empty")
+
+	printf("static const struct reg_bit %s_f%d[] = {\n%s};\n\n",
+	       rid, nfields, vals)
+	fields = fields sprintf("\t{ %s, \"%s\", 0x%.4x, %s_f%d, %d },\n",
+				fkind, fname, fmask, rid, nfields, nvals)
+	nfields++
+	fkind = ""
+}
+
+function end_reg() {
+	end_field()
+
+	if (rid == "")
+		return
+
+	printf("static const struct reg_field %s[] = {\n%s};\n\n", rid, fields)
+	regs = regs sprintf("\t\t[0x%.2x] = { \"%s\", %s, %d },\n",
+			    raddr, rname, rid, nfields)
+	rid = ""
+}
+
+function end_table() {
+	end_reg()
+
+	if (tid == "")
+		return
+
+	printf("const struct reg_table reg_%s = {\n", tid)
+	printf("\t.prefix = \"%s\",\n", tprefix)
+	printf("\t.summary = { %s-1 },\n", tsummary)
+	printf("\t.regs = {\n%s\t},\n};\n\n", regs)
+	tid = ""
+}
+
+function num(s) {
+	s = tolower(s)
+	if (s !~ /^0x[0-9a-f]+$/ && s !~ /^[0-9]+$/)
+		fail("bad number " s)
+
+	return (s ~ /^0x/) ? hex(substr(s, 3)) : s + 0
+}
+
+function hex(s,    i, v) {
+	v = 0
+	for (i = 1; i <= length(s); i++)
+		v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return v
+}
+
+BEGIN {
+	print "/* Generated from regs.desc by regs.awk, do not edit. */"
+	print ""
+	print "#include <stddef.h>"
+	print "#include <stdint.h>"
+	print ""
+	print "#include <linux/mdio.h>"
+	print "#include <net/if.h>"
+	print ""
+	print "#include \"phytool.h\""
+	print ""
+}
+
+/^[ \t]*(#|$)/ { next }
+
+$1 == "table" {
+	end_table()
+
+	if (NF < 3)
+		fail("table needs an ID and a prefix")
+
+	tid = $2
+	tprefix = $3
+	tsummary = ""
+	for (i = 4; i <= NF; i++)
+		tsummary = tsummary num($i) ", "
+	regs = ""
+	next
+}
+
+$1 == "reg" {
+	if (tid == "")
+		fail("reg outside of a table")
+
+	end_reg()
+
+	raddr = num($2)
+	if (raddr > 31)
+		fail("register " $2 " out of range")
+
+	rname = $3
+	rid = sprintf("%s_r%.2x", tid, raddr)
+	fields = ""
+	nfields = 0
+	next
+}
+
+$1 == "flags" || $1 == "enum" || $1 == "hex" {
+	if (rid == "")
+		fail($1 " outside of a reg")
+
+	end_field()
+
+	if ($1 == "hex") {
+		fields = fields sprintf("\t{ REG_HEX, \"%s\", 0x%.4x, NULL, 0 },\n",
+					$2, num($3))
+		nfields++
+		next
+	}
+
+	fkind = ($1 == "flags") ? "REG_FLAGS" : "REG_ENUM"
+	fname = $2
+	fmask = ($1 == "enum") ? num($3) : 0
+	vals = ""
+	nvals = 0
+	next
+}
+
+$1 == "bit" || $1 == "val" {
+	if (fkind != (($1 == "bit") ? "REG_FLAGS" : "REG_ENUM"))
+		fail($1 " outside of a matching field")
+
+	text = $0
+	sub(/^[ \t]*[a-z]+[ \t]+[^ \t]+[ \t]+/, "", text)
+	vals = vals sprintf("\t{ 0x%.4x, \"%s\" },\n", num($2), text)
+	nvals++
+	next
+}
+
+{ fail("unknown directive " $1) }
+
+END {
+	if (!failed)
+		end_table()
+}
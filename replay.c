@@ -0,0 +1,256 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+struct decode {
+	struct applet *a;
+	int all;
+
+	/* where bare values, as `read` prints them, are loaded from */
+	struct loc start;
+
+	/* distinct locations of the current file, in load order */
+	struct loc *locs;
+	int n;
+
+	struct loc last;
+};
+
+struct decode_worker {
+	pid_t pid;
+	FILE *out;
+
+	char **files;
+	int n;
+};
+
+static int decode_collect(const struct loc *loc, uint16_t val, void *arg)
+{
+	struct decode *d = arg;
+	struct loc *l;
+	int i;
+
+	(void)val;
+
+	/* dumps are in runs of one location, so check the last one first */
+	for (i = d->n - 1; i >= 0; i--) {
+		if (d->locs[i].phy_id == loc->phy_id &&
+		    !strncmp(d->locs[i].ifnam, loc->ifnam, IFNAMSIZ))
+			return 0;
+	}
+
+	l = realloc(d->locs, (d->n + 1) * sizeof(*l));
+	if (!l)
+		return -ENOMEM;
+
+	d->locs = l;
+	d->locs[d->n] = *loc;
+	d->locs[d->n++].reg = REG_SUMMARY;
+	return 0;
+}
+
+static int decode_reg(const struct loc *loc, uint16_t val, void *arg)
+{
+	struct decode *d = arg;
+	char name[48];
+
+	if (emit_fmt == EMIT_TEXT && (loc->phy_id != d->last.phy_id ||
+	    strncmp(loc->ifnam, d->last.ifnam, IFNAMSIZ))) {
+		loc_str(loc, name, sizeof(name));
+		printf("%*s%s\n", INDENT, "", name);
+		d->last = *loc;
+	}
+
+	if (d->a->print == print_mv6tool)
+		print_mv6_reg(loc, val, 2 * INDENT);
+	else
+		print_phy_reg(loc, val, 2 * INDENT);
+
+	return 0;
+}
+
+static int decode_file(struct decode *d, const char *path)
+{
+	int err, i;
+
+	err = sim_replay(path, &d->start);
+	if (err) {
+		fprintf(stderr, "error: %s: unable to load (%d)\n", path, err);
+		return err;
+	}
+
+	if (emit_fmt == EMIT_TEXT) {
+		printf("%s:\n", path);
+	} else {
+		emit_begin();
+		emit_str("file", path);
+		emit_end();
+	}
+
+	if (d->all) {
+		memset(&d->last, 0, sizeof(d->last));
+		return sim_regs(decode_reg, d);
+	}
+
+	d->n = 0;
+	err = sim_regs(decode_collect, d);
+	if (err)
+		return err;
+
+	for (i = 0; i < d->n; i++) {
+		d->a->print(&d->locs[i], INDENT);
+		emit_sep();
+	}
+
+	return 0;
+}
+
+static int decode_files(struct decode *d, char **files, int n)
+{
+	int err = 0, i;
+
+	for (i = 0; i < n; i++)
+		err = decode_file(d, files[i]) ? : err;
+
+	return err;
+}
+
+static int decode_copy(FILE *from)
+{
+	char buf[1 << 16];
+	size_t len;
+
+	rewind(from);
+	while ((len = fread(buf, 1, sizeof(buf), from)))
+		if (fwrite(buf, 1, len, stdout) != len)
+			return -EIO;
+
+	return ferror(from) ? -EIO : 0;
+}
+
+/* Each worker decodes a contiguous share of the files into a file of
+ * its own, which are then copied out in order. That keeps the output
+ * identical to a serial run. */
+static int decode_parallel(struct decode *d, char **files, int n, int jobs)
+{
+	struct decode_worker *w;
+	int err = 0, i, status;
+
+	w = calloc(jobs, sizeof(*w));
+	if (!w)
+		return -ENOMEM;
+
+	fflush(stdout);
+
+	for (i = 0; i < jobs; i++) {
+		w[i].files = &files[(long)n * i / jobs];
+		w[i].n = (long)n * (i + 1) / jobs - (long)n * i / jobs;
+
+		w[i].out = tmpfile();
+		if (!w[i].out) {
+			err = -errno;
+			break;
+		}
+
+		w[i].pid = fork();
+		if (w[i].pid < 0) {
+			err = -errno;
+			break;
+		}
+
+		if (!w[i].pid) {
+			if (dup2(fileno(w[i].out), STDOUT_FILENO) < 0)
+				_exit(1);
+
+			err = decode_files(d, w[i].files, w[i].n);
+			fflush(stdout);
+			_exit(err ? 1 : 0);
+		}
+	}
+
+	for (i = 0; i < jobs; i++) {
+		if (w[i].pid > 0) {
+			if (waitpid(w[i].pid, &status, 0) < 0 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status))
+				err = err ? : -EIO;
+
+			if (decode_copy(w[i].out))
+				err = err ? : -EIO;
+		}
+
+		if (w[i].out)
+			fclose(w[i].out);
+	}
+
+	free(w);
+	return err;
+}
+
+int phytool_decode(struct applet *a, int argc, char **argv)
+{
+	struct decode d = { .a = a };
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int err;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-a")) {
+			d.all = 1;
+			argc--, argv++;
+		} else if (!strcmp(argv[0], "-l") && argc > 1) {
+			if (a->parse_loc(argv[1], &d.start, 1) ||
+			    d.start.reg == REG_SUMMARY)
+				return 1;
+
+			argc -= 2, argv += 2;
+		} else if (!strcmp(argv[0], "-j") && argc > 1) {
+			jobs = strtol(argv[1], NULL, 0);
+			argc -= 2, argv += 2;
+		} else {
+			return 1;
+		}
+	}
+
+	if (!argc)
+		return 1;
+
+	err = mdio_backend_select("replay");
+	if (err)
+		return 1;
+
+	if (jobs > argc)
+		jobs = argc;
+
+	if (jobs > 1)
+		err = decode_parallel(&d, argv, argc, jobs);
+	else
+		err = decode_files(&d, argv, argc);
+
+	free(d.locs);
+	return err ? 1 : 0;
+}
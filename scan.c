@@ -0,0 +1,364 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define SCAN_ADDRS 32
+#define SCAN_MMDS  32
+
+struct scan_bus {
+	char ifnam[IFNAMSIZ];
+	char key[TOPO_BUS_LEN];
+	pthread_t tid;
+	int started;
+	int c45;
+
+	/* the next interface on the same MDIO bus, scanned after this
+	 * one by the same worker */
+	struct scan_bus *chain;
+	int shared;
+
+	int err;
+	uint32_t id[SCAN_ADDRS];
+
+	/* c45 only, devices in package and the ID of each of them */
+	uint32_t devs[SCAN_ADDRS];
+	uint32_t mmd_id[SCAN_ADDRS][SCAN_MMDS];
+};
+
+struct scan {
+	struct scan_bus *bus;
+	int n;
+	int c45;
+	int all;
+};
+
+/* MMDs asked for the package contents, in order. Nearly everything
+ * answers on the PMA/PMD, the rest covers PHYs without one. */
+static const int scan_pkg_mmds[] = {
+	MDIO_MMD_PMAPMD,
+	MDIO_MMD_PCS,
+	MDIO_MMD_PHYXS,
+	MDIO_MMD_AN,
+	MDIO_MMD_VEND1,
+	MDIO_MMD_VEND2,
+};
+
+static const char *scan_mmd_str[SCAN_MMDS] = {
+	[MDIO_MMD_PMAPMD] = "pma-pmd",
+	[MDIO_MMD_WIS]    = "wis",
+	[MDIO_MMD_PCS]    = "pcs",
+	[MDIO_MMD_PHYXS]  = "phy-xs",
+	[MDIO_MMD_DTEXS]  = "dte-xs",
+	[MDIO_MMD_TC]     = "tc",
+	[MDIO_MMD_AN]     = "an",
+	[MDIO_MMD_C22EXT] = "c22-ext",
+	[MDIO_MMD_VEND1]  = "vendor1",
+	[MDIO_MMD_VEND2]  = "vendor2",
+};
+
+static int scan_add(const char *ifnam, void *arg)
+{
+	struct scan *scan = arg;
+	struct scan_bus *bus;
+	char key[TOPO_BUS_LEN];
+	int i;
+
+	topo_if_bus(ifnam, key, sizeof(key));
+
+	for (i = 0; i < scan->n; i++) {
+		if (strcmp(scan->bus[i].key, key))
+			continue;
+
+		/* every interface would list the same PHYs */
+		if (scan->all)
+			return 0;
+
+		break;
+	}
+
+	bus = realloc(scan->bus, (scan->n + 1) * sizeof(*bus));
+	if (!bus)
+		return -ENOMEM;
+
+	scan->bus = bus;
+	bus = &scan->bus[scan->n];
+	memset(bus, 0, sizeof(*bus));
+	strncpy(bus->ifnam, ifnam, IFNAMSIZ - 1);
+	strcpy(bus->key, key);
+	bus->c45 = scan->c45;
+	bus->shared = i < scan->n;
+
+	scan->n++;
+	return 0;
+}
+
+/* Same test as phylib, a floating bus reads all ones */
+static int scan_present(uint32_t id)
+{
+	return id && (id & 0x1fffffff) != 0x1fffffff;
+}
+
+static int scan_id(const struct loc *loc, uint32_t *id)
+{
+	struct loc loc_id = *loc;
+	uint16_t hi, lo;
+	int err;
+
+	loc_id.reg = MII_PHYSID1;
+	err = mdio_read(&loc_id, &hi);
+	if (err)
+		return err;
+
+	loc_id.reg = MII_PHYSID2;
+	err = mdio_read(&loc_id, &lo);
+	if (err)
+		return err;
+
+	*id = (hi << 16) | lo;
+	return 0;
+}
+
+static int scan_pkg(struct loc *loc, int port, uint32_t *devs)
+{
+	struct loc loc_devs = *loc;
+	uint16_t lo, hi;
+	size_t i;
+	int err;
+
+	for (i = 0; i < sizeof(scan_pkg_mmds) / sizeof(scan_pkg_mmds[0]); i++) {
+		loc_devs.phy_id = mdio_phy_id_c45(port, scan_pkg_mmds[i]);
+
+		loc_devs.reg = MDIO_DEVS1;
+		err = mdio_read(&loc_devs, &lo);
+		if (err)
+			return err;
+
+		loc_devs.reg = MDIO_DEVS2;
+		err = mdio_read(&loc_devs, &hi);
+		if (err)
+			return err;
+
+		*devs = (hi << 16) | lo;
+		if (scan_present(*devs))
+			return 0;
+	}
+
+	*devs = 0;
+	return 0;
+}
+
+static int scan_port_c45(struct scan_bus *bus, struct loc *loc, int port)
+{
+	int err, mmd;
+
+	err = scan_pkg(loc, port, &bus->devs[port]);
+	if (err)
+		return err;
+
+	/* only visit the MMDs that the package says are there */
+	for (mmd = 1; mmd < SCAN_MMDS; mmd++) {
+		if (!(bus->devs[port] & MDIO_DEVS_PRESENT(mmd)))
+			continue;
+
+		loc->phy_id = mdio_phy_id_c45(port, mmd);
+		err = scan_id(loc, &bus->mmd_id[port][mmd]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static void *scan_bus(void *arg)
+{
+	struct scan_bus *bus = arg;
+	struct loc loc;
+	int addr;
+
+	memset(&loc, 0, sizeof(loc));
+	strncpy(loc.ifnam, bus->ifnam, IFNAMSIZ - 1);
+
+	for (addr = 0; addr < SCAN_ADDRS; addr++) {
+		if (bus->c45) {
+			bus->err = scan_port_c45(bus, &loc, addr);
+			if (bus->err)
+				break;
+
+			continue;
+		}
+
+		loc.phy_id = addr;
+
+		/* no MDIO bus behind this interface, give up right away */
+		bus->err = scan_id(&loc, &bus->id[addr]);
+		if (bus->err)
+			break;
+	}
+
+	return NULL;
+}
+
+static void *scan_chain(void *arg)
+{
+	struct scan_bus *bus;
+
+	for (bus = arg; bus; bus = bus->chain)
+		scan_bus(bus);
+
+	return NULL;
+}
+
+static void scan_print_c45(struct scan_bus *bus)
+{
+	char addr[16];
+	int port, mmd;
+
+	for (port = 0; port < SCAN_ADDRS; port++) {
+		for (mmd = 1; mmd < SCAN_MMDS; mmd++) {
+			if (!(bus->devs[port] & MDIO_DEVS_PRESENT(mmd)))
+				continue;
+
+			if (emit_fmt != EMIT_TEXT) {
+				emit_begin();
+				emit_str("iface", bus->ifnam);
+				emit_uint("port", port);
+				emit_uint("dev", mmd);
+				emit_uint("id", bus->mmd_id[port][mmd]);
+				emit_str("mmd", scan_mmd_str[mmd] ? : "unknown");
+				emit_end();
+				continue;
+			}
+
+			snprintf(addr, sizeof(addr), "0x%.2x:0x%.2x", port, mmd);
+			printf("%-16s %-9s 0x%.8x  %s\n", bus->ifnam, addr,
+			       bus->mmd_id[port][mmd],
+			       scan_mmd_str[mmd] ? : "unknown");
+		}
+	}
+}
+
+static void scan_print(struct scan_bus *bus)
+{
+	int addr;
+
+	if (bus->c45) {
+		scan_print_c45(bus);
+		return;
+	}
+
+	for (addr = 0; addr < SCAN_ADDRS; addr++) {
+		if (!scan_present(bus->id[addr]))
+			continue;
+
+		if (emit_fmt == EMIT_TEXT) {
+			printf("%-16s 0x%.2x  0x%.8x\n", bus->ifnam, addr,
+			       bus->id[addr]);
+			continue;
+		}
+
+		emit_begin();
+		emit_str("iface", bus->ifnam);
+		emit_uint("addr", addr);
+		emit_uint("id", bus->id[addr]);
+		emit_end();
+	}
+}
+
+int phytool_scan(struct applet *a, int argc, char **argv)
+{
+	struct scan scan = { .bus = NULL };
+	int err = 0, i, j;
+
+	(void)a;
+
+	scan.all = !argc;
+
+	if (argc && (!strcmp(argv[0], "c22") || !strcmp(argv[0], "c45"))) {
+		scan.c45 = !strcmp(argv[0], "c45");
+		scan.all = !--argc;
+		argv++;
+	}
+
+	for (; argc; argc--, argv++) {
+		err = scan_add(argv[0], &scan);
+		if (err)
+			goto out;
+	}
+
+	if (scan.all) {
+		err = mdio_ifaces(scan_add, &scan);
+		if (err)
+			goto out;
+	}
+
+	/* One worker per MDIO bus, running the interfaces on it one after
+	 * the other. Buses are serialised by their own drivers, but
+	 * interfaces sharing one would only interleave on it. */
+	for (i = 0; i < scan.n; i++) {
+		for (j = i + 1; j < scan.n; j++) {
+			if (!strcmp(scan.bus[i].key, scan.bus[j].key)) {
+				scan.bus[i].chain = &scan.bus[j];
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < scan.n; i++) {
+		if (scan.bus[i].shared)
+			continue;
+
+		if (!pthread_create(&scan.bus[i].tid, NULL, scan_chain, &scan.bus[i]))
+			scan.bus[i].started = 1;
+		else
+			scan_chain(&scan.bus[i]);
+	}
+
+	for (i = 0; i < scan.n; i++) {
+		if (scan.bus[i].started)
+			pthread_join(scan.bus[i].tid, NULL);
+	}
+
+	/* column headings, text only */
+	if (emit_fmt == EMIT_TEXT && scan.c45)
+		printf("%-16s %-9s %-11s %s\n", "IFACE", "ADDR", "ID", "MMD");
+	else if (emit_fmt == EMIT_TEXT)
+		printf("%-16s %-5s %s\n", "IFACE", "ADDR", "ID");
+
+	for (i = 0; i < scan.n; i++) {
+		if (scan.bus[i].err && !scan.all) {
+			fprintf(stderr, "error: %s: scan failed (%d)\n",
+				scan.bus[i].ifnam, scan.bus[i].err);
+			err = scan.bus[i].err;
+		}
+
+		scan_print(&scan.bus[i]);
+	}
+
+out:
+	free(scan.bus);
+	return err ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define SHM_MAGIC   0x70687973	/* "phys" */
+#define SHM_VERSION 1
+
+/* Set last, readers attaching before that get -EAGAIN */
+struct shm_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nents;
+	uint32_t ent_size;
+	uint64_t period;
+};
+
+/* One register, on a cache line of its own. SEQ is odd while the
+ * publisher is updating it. */
+struct shm_ent {
+	uint32_t seq;
+	uint32_t gen;
+	uint64_t stamp;
+	int32_t  err;
+	uint16_t val;
+
+	struct loc loc;
+} __attribute__((aligned(64)));
+
+static inline void shm_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+static size_t shm_size(uint32_t nents)
+{
+	return sizeof(struct shm_ent) * (nents + 1);
+}
+
+static struct shm_ent *shm_ents(const struct shm_seg *seg)
+{
+	/* the header takes the first slot, keeping entries aligned */
+	return (struct shm_ent *)seg->hdr + 1;
+}
+
+int shm_create(struct shm_seg *seg, const char *name, const struct loc *locs,
+	       int n, uint64_t period)
+{
+	struct shm_ent *ents;
+	int fd, i;
+
+	/* never resize a segment under existing readers, they keep
+	 * their mapping of the old one instead */
+	shm_unlink(name);
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	seg->size = shm_size(n);
+	if (ftruncate(fd, seg->size)) {
+		close(fd);
+		shm_unlink(name);
+		return -errno;
+	}
+
+	seg->hdr = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	close(fd);
+	if (seg->hdr == MAP_FAILED) {
+		shm_unlink(name);
+		return -errno;
+	}
+
+	ents = shm_ents(seg);
+	for (i = 0; i < n; i++)
+		ents[i].loc = locs[i];
+
+	seg->hdr->version = SHM_VERSION;
+	seg->hdr->nents = n;
+	seg->hdr->ent_size = sizeof(*ents);
+	seg->hdr->period = period;
+	__atomic_store_n(&seg->hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Only ever called by the single publisher */
+void shm_publish(struct shm_seg *seg, int i, uint16_t val, int err,
+		 uint64_t stamp)
+{
+	struct shm_ent *ent = &shm_ents(seg)[i];
+	uint32_t seq = ent->seq, gen = ent->gen;
+
+	if (!gen || ent->val != val || ent->err != err)
+		gen++;
+
+	__atomic_store_n(&ent->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&ent->gen, gen, __ATOMIC_RELAXED);
+	__atomic_store_n(&ent->stamp, stamp, __ATOMIC_RELAXED);
+	__atomic_store_n(&ent->err, err, __ATOMIC_RELAXED);
+	if (!err)
+		__atomic_store_n(&ent->val, val, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&ent->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int shm_attach(struct shm_seg *seg, const char *name)
+{
+	struct stat st;
+	int err = 0, fd;
+
+	fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -errno;
+	}
+
+	if ((size_t)st.st_size < shm_size(0)) {
+		close(fd);
+		return -EAGAIN;
+	}
+
+	seg->size = st.st_size;
+	seg->hdr = mmap(NULL, seg->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg->hdr == MAP_FAILED)
+		return -errno;
+
+	if (__atomic_load_n(&seg->hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC)
+		err = -EAGAIN;
+	else if (seg->hdr->version != SHM_VERSION ||
+		 seg->hdr->ent_size != sizeof(struct shm_ent) ||
+		 seg->size < shm_size(seg->hdr->nents))
+		err = -ENOEXEC;
+
+	if (err)
+		shm_detach(seg);
+
+	return err;
+}
+
+void shm_detach(struct shm_seg *seg)
+{
+	munmap(seg->hdr, seg->size);
+	seg->hdr = NULL;
+}
+
+int shm_count(const struct shm_seg *seg)
+{
+	return seg->hdr->nents;
+}
+
+uint64_t shm_period(const struct shm_seg *seg)
+{
+	return seg->hdr->period;
+}
+
+int shm_get(const struct shm_seg *seg, int i, struct shm_val *v)
+{
+	const struct shm_ent *ent;
+	uint32_t seq;
+
+	if (i < 0 || (uint32_t)i >= seg->hdr->nents)
+		return -ENOENT;
+
+	ent = &shm_ents(seg)[i];
+	v->loc = ent->loc;
+
+	do {
+		while ((seq = __atomic_load_n(&ent->seq, __ATOMIC_ACQUIRE)) & 1)
+			shm_relax();
+
+		v->gen   = __atomic_load_n(&ent->gen, __ATOMIC_RELAXED);
+		v->stamp = __atomic_load_n(&ent->stamp, __ATOMIC_RELAXED);
+		v->err   = __atomic_load_n(&ent->err, __ATOMIC_RELAXED);
+		v->val   = __atomic_load_n(&ent->val, __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&ent->seq, __ATOMIC_RELAXED) != seq);
+
+	return 0;
+}
+
+int shm_find(const struct shm_seg *seg, const struct loc *loc)
+{
+	const struct shm_ent *ents = shm_ents(seg);
+	uint32_t i;
+
+	for (i = 0; i < seg->hdr->nents; i++) {
+		if (loc_eq(&ents[i].loc, loc))
+			return i;
+	}
+
+	return -ENOENT;
+}
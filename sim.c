@@ -0,0 +1,1036 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+#define SIM_BUCKETS 1024
+
+/* Periodically clears MASK for DOWN out of every PERIOD ns, latching
+ * the low state until the next read like a BMSR link bit does. */
+struct sim_flap {
+	uint16_t mask;
+	int latched;
+
+	uint64_t period;
+	uint64_t down;
+	uint64_t last;
+};
+
+/* Attached to a BMSR. Restarting aneg or resetting the PHY through
+ * its BMCR takes aneg-complete down for aneg ns and link, latching
+ * low, for link ns, both stretched by up to jitter ns. */
+struct sim_aneg {
+	uint64_t aneg;
+	uint64_t link;
+	uint64_t jitter;
+
+	uint64_t aneg_done;
+	uint64_t link_done;
+	int latched;
+};
+
+struct sim_reg {
+	struct sim_reg *next;
+	struct sim_reg *order;
+
+	struct loc loc;
+	uint16_t val;
+
+	struct sim_flap *flap;
+	struct sim_aneg *aneg;
+};
+
+/* An ATU entry of the switch whose Global1 registers are at loc */
+struct sim_atu {
+	struct loc loc;
+	uint16_t fid;
+	uint8_t mac[6];
+	uint16_t data;
+};
+
+/* The stats counters of a port of the switch whose Global1 registers
+ * are at loc, counting up at rate per second */
+struct sim_stats {
+	struct loc loc;
+	int port;
+	uint32_t rate[STATS_COUNTERS];
+};
+
+struct sim_if {
+	struct sim_if *next;
+
+	char ifnam[IFNAMSIZ];
+};
+
+static struct sim {
+	struct sim_reg *regs[SIM_BUCKETS];
+	struct sim_if  *ifs;
+
+	/* every register, in load order */
+	struct sim_reg *first;
+	struct sim_reg **last;
+
+	long latency;
+	uint64_t epoch;
+
+	/* SMI PHY and ATU commands stay busy for smi ns, until smi_done */
+	long smi;
+	uint64_t smi_done;
+
+	/* ATU entries, sorted on the first GetNext */
+	struct sim_atu *atu;
+	size_t natu;
+	int atu_sorted;
+
+	/* stats counters, and the last port captured */
+	struct sim_stats *stats;
+	size_t nstats;
+	uint32_t stats_cap[STATS_COUNTERS];
+
+	/* for aneg jitter, the same on every run */
+	uint64_t seed;
+
+	/* set once the image has a paged register, the page register
+	 * is left alone otherwise */
+	int paged;
+} sim;
+
+/* Writers are serialised, readers walk the lists without it. New
+ * entries are only ever published fully formed. */
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Used when no image is given. sim0 is a Marvell 88E1510 at address
+ * 0 with link up at 1000-full, renegotiating in a (scaled down) 3ms
+ * after a restart, sim1 is an mv88e6352 at switch address
+ * 0 whose switch ID is in register 3 of every port, with an internal
+ * PHY behind port 0, a couple of ATU entries and traffic on ports 0
+ * and 5, and sim2 is a C45 Marvell 88X3310 at port 0. */
+static const char *sim_default_image[] = {
+	"sim0/0/0       0x1140",
+	"sim0/0/1       0x796d 0x0141 0x0dd1 0x01e1 0xc5e1 0x000f 0x2001",
+	"sim0/0/9       0x0300 0x3c00",
+	"sim0/0/0xf     0x3000",
+	"aneg sim0/0    3000000 3500000 500000",
+
+	"sim1/0:0x10/0  0x1e0f 0x0003 0x0000 0x3521 0x007f",
+	"sim1/0:0x11/0  0x1e0f 0x0003 0x0000 0x3521 0x007f",
+	"sim1/0:0x12/0  0x1e0f 0x0003 0x0000 0x3521 0x007f",
+	"sim1/0:0x13/0  0x100f 0x0003 0x0000 0x3521 0x007c",
+	"sim1/0:0x14/0  0x100f 0x0003 0x0000 0x3521 0x007c",
+	"sim1/0:0x15/0  0x1e0f 0x0003 0x0000 0x3521 0x007f",
+	"sim1/0:0x16/0  0x1e0f 0x0003 0x0000 0x3521 0x017f",
+	"sim1/0:0x1b/0  0xc800",
+	"sim1/0:0x1c/0x18 0x0000 0x0000",
+	"sim1/0:0/0     0x1140 0x796d 0x0141 0x0eb1 0x01e1 0xc5e1 0x000f",
+	"atu sim1/0:0x1b 0 00:11:22:33:44:55 0x01 7",
+	"atu sim1/0:0x1b 0 01:80:c2:00:00:0e 0x40 0xf",
+	"stats sim1/0:0x1b 0 125000 0 0 0 100 0 0 0 0 0 0 0 0 100",
+	"stats sim1/0:0x1b 5 0 0 0 0 0 0 0 0 0 0 0 0 0 0 125000 0 100",
+
+	"sim2/0:1/0     0x2040 0x0006 0x002b 0x09aa 0x0000 0x009a 0xc000",
+	"sim2/0:3/0     0x2040 0x0006 0x002b 0x09aa 0x0000 0x009a 0xc000",
+	"sim2/0:4/0     0x2040 0x0006 0x002b 0x09aa 0x0000 0x009a 0xc000",
+	"sim2/0:7/0     0x3000 0x0008 0x002b 0x09aa 0x0000 0x009a 0xc000",
+	"sim2/0:30/2    0x002b 0x09aa 0x0000 0x009a 0xc000",
+	"sim2/0:31/2    0x002b 0x09aa 0x0000 0x009a 0xc000",
+
+	NULL
+};
+
+static unsigned sim_hash(const struct loc *loc)
+{
+	const char *c;
+	unsigned h = 2166136261u;
+
+	for (c = loc->ifnam; *c && c < &loc->ifnam[IFNAMSIZ]; c++)
+		h = (h ^ *c) * 16777619u;
+
+	h = (h ^ loc->phy_id) * 16777619u;
+	h = (h ^ loc->reg) * 16777619u;
+	h = (h ^ loc->page) * 16777619u;
+	return h % SIM_BUCKETS;
+}
+
+static struct sim_reg *sim_find(const struct loc *loc)
+{
+	struct sim_reg *r;
+
+	r = __atomic_load_n(&sim.regs[sim_hash(loc)], __ATOMIC_ACQUIRE);
+	for (; r; r = r->next) {
+		if (loc_eq(&r->loc, loc))
+			return r;
+	}
+
+	return NULL;
+}
+
+/* Page 0 and the page register itself are stored as plain locations,
+ * so that both spellings of them find the same register. Registers
+ * reached through the C22 MMD registers are the C45 ones. */
+static void sim_key(const struct loc *loc, struct loc *key)
+{
+	*key = *loc;
+	key->flags &= ~LOC_F_MMD;
+
+	if (!loc->page || loc->reg == PAGE_REG) {
+		key->page = 0;
+		key->flags &= ~LOC_F_PAGE;
+	}
+}
+
+/* The register a plain access from the bus ends up at, given the page
+ * currently selected on the PHY */
+static void sim_bus_key(const struct loc *loc, struct loc *key)
+{
+	struct loc loc_page = *loc;
+	struct sim_reg *r;
+
+	*key = *loc;
+
+	if (!__atomic_load_n(&sim.paged, __ATOMIC_RELAXED) ||
+	    loc_is_c45(loc) || loc->reg == PAGE_REG)
+		return;
+
+	loc_page.reg = PAGE_REG;
+	r = sim_find(&loc_page);
+	if (!r || !(r->val & 0xff))
+		return;
+
+	key->page = r->val & 0xff;
+	key->flags |= LOC_F_PAGE;
+}
+
+static struct sim_if *sim_find_if(const char *ifnam)
+{
+	struct sim_if *i;
+
+	i = __atomic_load_n(&sim.ifs, __ATOMIC_ACQUIRE);
+	for (; i; i = __atomic_load_n(&i->next, __ATOMIC_ACQUIRE)) {
+		if (!strncmp(i->ifnam, ifnam, IFNAMSIZ))
+			return i;
+	}
+
+	return NULL;
+}
+
+static int sim_add(const struct loc *loc, uint16_t val)
+{
+	struct sim_reg *r = sim_find(loc);
+	struct sim_if *i, **last;
+	unsigned h;
+
+	/* lost a race with another writer */
+	if (r) {
+		r->val = val;
+		return 0;
+	}
+
+	if (!sim_find_if(loc->ifnam)) {
+		i = calloc(1, sizeof(*i));
+		if (!i)
+			return -ENOMEM;
+
+		strncpy(i->ifnam, loc->ifnam, IFNAMSIZ - 1);
+		for (last = &sim.ifs; *last; last = &(*last)->next);
+		__atomic_store_n(last, i, __ATOMIC_RELEASE);
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return -ENOMEM;
+
+	h = sim_hash(loc);
+	r->loc = *loc;
+	r->val = val;
+	r->next = sim.regs[h];
+	__atomic_store_n(&sim.regs[h], r, __ATOMIC_RELEASE);
+
+	if (!sim.last)
+		sim.last = &sim.first;
+	*sim.last = r;
+	sim.last = &r->order;
+	return 0;
+}
+
+int sim_set(const struct loc *loc, uint16_t val)
+{
+	struct sim_reg *r;
+	struct loc key;
+	int err;
+
+	sim_key(loc, &key);
+
+	r = sim_find(&key);
+	if (r) {
+		r->val = val;
+		return 0;
+	}
+
+	pthread_mutex_lock(&sim_lock);
+	err = sim_add(&key, val);
+	if (!err && loc_is_paged(&key))
+		__atomic_store_n(&sim.paged, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&sim_lock);
+	return err;
+}
+
+/* Forget every register and interface, e.g. between replayed files */
+void sim_reset(void)
+{
+	struct sim_reg *r, *rnext;
+	struct sim_if *i, *inext;
+
+	for (r = sim.first; r; r = rnext) {
+		rnext = r->order;
+		free(r->flap);
+		free(r->aneg);
+		free(r);
+	}
+
+	for (i = sim.ifs; i; i = inext) {
+		inext = i->next;
+		free(i);
+	}
+
+	free(sim.atu);
+	free(sim.stats);
+	memset(&sim, 0, sizeof(sim));
+	sim.epoch = mono_ns();
+}
+
+int sim_regs(int (*cb)(const struct loc *loc, uint16_t val, void *arg),
+	     void *arg)
+{
+	struct sim_reg *r;
+	int err = 0;
+
+	for (r = sim.first; !err && r; r = r->order)
+		err = cb(&r->loc, r->val, arg);
+
+	return err;
+}
+
+/* flap IFACE/ADDR/REG MASK PERIOD DOWN */
+static int sim_load_flap(char *save)
+{
+	char *tok[4];
+	struct sim_flap *f;
+	struct sim_reg *r;
+	struct loc loc, key;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		tok[i] = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok[i])
+			return -EINVAL;
+	}
+
+	if (phytool_parse_loc(tok[0], &loc, 1))
+		return -EINVAL;
+
+	sim_key(&loc, &key);
+	r = sim_find(&key);
+	if (!r)
+		return -ENOENT;
+
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return -ENOMEM;
+
+	f->mask = strtoul(tok[1], NULL, 0);
+	f->period = strtoull(tok[2], NULL, 0);
+	f->down = strtoull(tok[3], NULL, 0);
+	f->latched = !loc_is_c45(&loc) && loc.reg == MII_BMSR;
+	if (!f->period || f->down > f->period) {
+		free(f);
+		return -EINVAL;
+	}
+
+	free(r->flap);
+	r->flap = f;
+	return 0;
+}
+
+/* aneg IFACE/ADDR ANEG LINK [JITTER] */
+static int sim_load_aneg(char *save)
+{
+	struct sim_aneg *an;
+	struct sim_reg *r;
+	struct loc loc, key;
+	char *tok[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		tok[i] = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok[i] || tok[i][0] == '#') {
+			if (i < 3)
+				return -EINVAL;
+			tok[i] = "0";
+			break;
+		}
+	}
+
+	if (phytool_parse_loc(tok[0], &loc, 0) || loc_is_c45(&loc))
+		return -EINVAL;
+
+	loc.reg = MII_BMSR;
+	sim_key(&loc, &key);
+	r = sim_find(&key);
+	if (!r)
+		return -ENOENT;
+
+	an = calloc(1, sizeof(*an));
+	if (!an)
+		return -ENOMEM;
+
+	an->aneg = strtoull(tok[1], NULL, 0);
+	an->link = strtoull(tok[2], NULL, 0);
+	an->jitter = strtoull(tok[3], NULL, 0);
+	if (an->link < an->aneg) {
+		free(an);
+		return -EINVAL;
+	}
+
+	free(r->aneg);
+	r->aneg = an;
+	return 0;
+}
+
+/* atu IFACE/ADDR FID MAC PORTVEC STATE */
+static int sim_load_atu(char *save)
+{
+	struct sim_atu *atu, *a;
+	unsigned mac[6];
+	char *tok[5];
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		tok[i] = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok[i])
+			return -EINVAL;
+	}
+
+	atu = realloc(sim.atu, (sim.natu + 1) * sizeof(*atu));
+	if (!atu)
+		return -ENOMEM;
+
+	sim.atu = atu;
+	a = &atu[sim.natu];
+	memset(a, 0, sizeof(*a));
+
+	if (phytool_parse_loc(tok[0], &a->loc, 0) || !loc_is_c45(&a->loc))
+		return -EINVAL;
+
+	if (sscanf(tok[2], "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2],
+		   &mac[3], &mac[4], &mac[5]) != 6)
+		return -EINVAL;
+
+	a->loc.reg = 0;
+	a->fid = strtoul(tok[1], NULL, 0);
+	for (i = 0; i < 6; i++)
+		a->mac[i] = mac[i];
+	a->data  = (strtoul(tok[3], NULL, 0) << 4) & ATU_DATA_PORTVEC;
+	a->data |= strtoul(tok[4], NULL, 0) & ATU_DATA_STATE;
+	if (!(a->data & ATU_DATA_STATE) || a->fid > ATU_FID_MAX)
+		return -EINVAL;
+
+	sim.natu++;
+	sim.atu_sorted = 0;
+	return 0;
+}
+
+/* stats IFACE/ADDR PORT RATE... */
+static int sim_load_stats(char *save)
+{
+	struct sim_stats *stats, *st;
+	char *tok;
+	int i;
+
+	tok = strtok_r(NULL, " \t\r\n", &save);
+	if (!tok)
+		return -EINVAL;
+
+	stats = realloc(sim.stats, (sim.nstats + 1) * sizeof(*stats));
+	if (!stats)
+		return -ENOMEM;
+
+	sim.stats = stats;
+	st = &stats[sim.nstats];
+	memset(st, 0, sizeof(*st));
+
+	if (phytool_parse_loc(tok, &st->loc, 0) || !loc_is_c45(&st->loc))
+		return -EINVAL;
+
+	tok = strtok_r(NULL, " \t\r\n", &save);
+	if (!tok)
+		return -EINVAL;
+
+	st->loc.reg = 0;
+	st->port = strtol(tok, NULL, 0);
+
+	/* consecutive rates go to consecutive counters */
+	for (i = 0; i < STATS_COUNTERS; i++) {
+		tok = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok || tok[0] == '#')
+			break;
+
+		st->rate[i] = strtoul(tok, NULL, 0);
+	}
+
+	sim.nstats++;
+	return 0;
+}
+
+/* NEXT, unless NULL, is where the register after the last one loaded
+ * is kept, so that a line of bare values, as `read` prints them,
+ * carries on from there. No interface means there is nowhere yet. */
+static int sim_load_line(char *line, struct loc *next)
+{
+	char *tok, *end, *save;
+	struct loc loc;
+	unsigned long val;
+	int err;
+
+	/* parse_loc() uses strtok, so keep our own state */
+	tok = strtok_r(line, " \t\r\n", &save);
+	if (!tok || tok[0] == '#')
+		return 0;
+
+	if (!strcmp(tok, "flap"))
+		return sim_load_flap(save);
+
+	if (!strcmp(tok, "aneg"))
+		return sim_load_aneg(save);
+
+	if (!strcmp(tok, "atu"))
+		return sim_load_atu(save);
+
+	if (!strcmp(tok, "stats"))
+		return sim_load_stats(save);
+
+	if (!strcmp(tok, "latency")) {
+		tok = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok)
+			return -EINVAL;
+
+		sim.latency = strtol(tok, NULL, 0);
+		return 0;
+	}
+
+	if (!strcmp(tok, "smi")) {
+		tok = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok)
+			return -EINVAL;
+
+		sim.smi = strtol(tok, NULL, 0);
+		return 0;
+	}
+
+	strtoul(tok, &end, 0);
+	if (!*end) {
+		if (!next || !next->ifnam[0])
+			return -EINVAL;
+
+		loc = *next;
+	} else {
+		err = phytool_parse_loc(tok, &loc, 1);
+		if (err)
+			return err;
+
+		tok = strtok_r(NULL, " \t\r\n", &save);
+	}
+
+	/* consecutive values are loaded into consecutive registers */
+	for (; tok && tok[0] != '#'; tok = strtok_r(NULL, " \t\r\n", &save)) {
+		val = strtoul(tok, &end, 0);
+		if (*end || val > 0xffff)
+			return -EINVAL;
+
+		err = sim_set(&loc, val);
+		if (err)
+			return err;
+
+		loc.reg++;
+	}
+
+	if (next)
+		*next = loc;
+
+	return 0;
+}
+
+static int sim_load(FILE *fp, const struct loc *start)
+{
+	struct loc next = { .ifnam = { 0 } };
+	char *line = NULL;
+	size_t len = 0;
+	int lineno = 0, err = 0;
+
+	if (start)
+		next = *start;
+
+	while (!err && getline(&line, &len, fp) > 0) {
+		lineno++;
+		err = sim_load_line(line, &next);
+	}
+
+	if (err)
+		fprintf(stderr, "error: sim: bad image line %d\n", lineno);
+
+	free(line);
+	return err;
+}
+
+static int sim_open(const char *arg)
+{
+	const char **l;
+	char line[128];
+	FILE *fp;
+	int err;
+
+	sim.epoch = mono_ns();
+
+	if (!arg) {
+		for (l = sim_default_image; *l; l++) {
+			strncpy(line, *l, sizeof(line) - 1);
+			line[sizeof(line) - 1] = '\0';
+
+			err = sim_load_line(line, NULL);
+			if (err)
+				return err;
+		}
+
+		return 0;
+	}
+
+	fp = fopen(arg, "r");
+	if (!fp)
+		return -errno;
+
+	err = sim_load(fp, NULL);
+	fclose(fp);
+	return err;
+}
+
+/* Replace the store with the registers captured in path, either a
+ * snapshot or a dump in the IMAGE format. Bare values before the first
+ * location are loaded from start, if there is one. */
+int sim_replay(const char *path, const struct loc *start)
+{
+	FILE *fp;
+	int err;
+
+	sim_reset();
+
+	err = snapshot_load(path);
+	if (err != -ENOEXEC)
+		return err;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	err = sim_load(fp, start);
+	fclose(fp);
+	return err;
+}
+
+static int sim_replay_open(const char *arg)
+{
+	if (!arg) {
+		sim_reset();
+		return 0;
+	}
+
+	return sim_replay(arg, NULL);
+}
+
+/* Model the bus cycle time. MDIO transactions are in the tens of
+ * microseconds, so spin rather than sleep to keep the timing tight. */
+static void sim_delay(void)
+{
+	uint64_t end;
+
+	if (sim.latency <= 0)
+		return;
+
+	end = mono_ns() + sim.latency;
+	while (mono_ns() < end);
+}
+
+static uint16_t sim_flap(struct sim_flap *f, uint16_t val)
+{
+	uint64_t now = mono_ns() - sim.epoch, phase = now % f->period;
+	int down = phase < f->down;
+
+	/* latched low if the last down period ended after our last read */
+	if (!down && f->latched && f->last < now - phase + f->down)
+		down = 1;
+
+	f->last = now;
+	return down ? (val & ~f->mask) : val;
+}
+
+static uint16_t sim_aneg(struct sim_aneg *an, uint16_t val)
+{
+	uint64_t now = mono_ns();
+
+	if (now < an->aneg_done)
+		val &= ~BMSR_ANEGCOMPLETE;
+
+	if (now < an->link_done) {
+		val &= ~BMSR_LSTATUS;
+	} else if (an->latched) {
+		val &= ~BMSR_LSTATUS;
+		an->latched = 0;
+	}
+
+	return val;
+}
+
+/* Restarting aneg, or resetting, a PHY with an aneg model starts a
+ * new round of it. Both bits clear themselves. */
+static uint16_t sim_aneg_restart(const struct loc *key, uint16_t val)
+{
+	struct loc bmsr = *key;
+	struct sim_aneg *an;
+	struct sim_reg *r;
+	uint64_t jitter = 0, now;
+
+	if (loc_is_c45(key) || loc_is_paged(key) || key->reg != MII_BMCR ||
+	    !(val & (BMCR_ANRESTART | BMCR_RESET)))
+		return val;
+
+	bmsr.reg = MII_BMSR;
+	r = sim_find(&bmsr);
+	if (!r || !r->aneg)
+		return val;
+
+	an = r->aneg;
+	if (an->jitter) {
+		sim.seed = sim.seed * 6364136223846793005ULL +
+			1442695040888963407ULL;
+		jitter = (sim.seed >> 33) % an->jitter;
+	}
+
+	now = mono_ns();
+	an->aneg_done = now + an->aneg + jitter;
+	an->link_done = now + an->link + jitter;
+	an->latched = 1;
+
+	return val & ~(BMCR_ANRESTART | BMCR_RESET);
+}
+
+/* Once the MMD control register is set to a data function, the data
+ * register is a window onto the C45 register it was pointed at, which
+ * is the address last written to the data register in address mode. */
+static int sim_mmd_key(const struct loc *loc, struct loc *key, int write)
+{
+	struct loc loc_mmd = *loc;
+	struct sim_reg *ctrl, *addr;
+	uint16_t func;
+
+	if (loc_is_c45(loc) || loc->reg != MII_MMD_DATA)
+		return 0;
+
+	loc_mmd.reg = MII_MMD_CTRL;
+	ctrl = sim_find(&loc_mmd);
+	func = ctrl ? ctrl->val & ~MII_MMD_CTRL_DEVAD_MASK : 0;
+	if (func == MII_MMD_CTRL_ADDR)
+		return 0;
+
+	loc_mmd.reg = MII_MMD_DATA;
+	addr = sim_find(&loc_mmd);
+
+	memset(key, 0, sizeof(*key));
+	memcpy(key->ifnam, loc->ifnam, IFNAMSIZ);
+	key->phy_id = mdio_phy_id_c45(loc->phy_id,
+				      ctrl->val & MII_MMD_CTRL_DEVAD_MASK);
+	key->reg = addr ? addr->val : 0;
+
+	/* 0xc000 only steps on writes */
+	if (addr && (func == MII_MMD_CTRL_INCR_RDWT ||
+		     (func == 0xc000 && write)))
+		addr->val++;
+
+	return 1;
+}
+
+static int sim_is_smi_cmd(const struct loc *loc)
+{
+	return loc_is_c45(loc) && loc_c45_dev(loc) == SMI_G2 &&
+		loc->reg == SMI_PHY_CMD;
+}
+
+/* Run a Global2 SMI PHY command against the C45 registers of the PHY,
+ * the same ones that direct phyN accesses reach. Only C22 commands are
+ * modelled. */
+static int sim_smi(const struct loc *loc, uint16_t cmd)
+{
+	struct loc phy = *loc, data = *loc;
+	struct sim_reg *r;
+	int err = 0;
+
+	phy.phy_id = mdio_phy_id_c45(loc_c45_port(loc), (cmd >> 5) & 0x1f);
+	phy.reg = cmd & 0x1f;
+	data.reg = SMI_PHY_DATA;
+
+	if (!(cmd & SMI_MODE22)) {
+		;
+	} else if ((cmd & (SMI_OP_READ | SMI_OP_WRITE)) == SMI_OP_READ) {
+		r = sim_find(&phy);
+		err = sim_set(&data, r ? r->val : 0xffff);
+	} else if ((cmd & (SMI_OP_READ | SMI_OP_WRITE)) == SMI_OP_WRITE) {
+		r = sim_find(&data);
+		err = sim_set(&phy, r ? r->val : 0xffff);
+	}
+
+	sim.smi_done = mono_ns() + sim.smi;
+	return err ? : sim_set(loc, cmd);
+}
+
+static int sim_is_atu_op(const struct loc *loc)
+{
+	return loc_is_c45(loc) && loc_c45_dev(loc) == ATU_G1 &&
+		loc->reg == ATU_OP;
+}
+
+static int sim_atu_cmp(const void *_a, const void *_b)
+{
+	const struct sim_atu *a = _a, *b = _b;
+	int diff;
+
+	diff = strncmp(a->loc.ifnam, b->loc.ifnam, IFNAMSIZ);
+	if (!diff)
+		diff = (int)loc_c45_port(&a->loc) - (int)loc_c45_port(&b->loc);
+	if (!diff)
+		diff = (int)a->fid - (int)b->fid;
+
+	return diff ? : memcmp(a->mac, b->mac, sizeof(a->mac));
+}
+
+/* Run an ATU op, of which only GetNext is modelled: the entry after
+ * the MAC registers in the FID register's database, or an entry state
+ * of 0 and the broadcast address past the last one. */
+static int sim_atu(const struct loc *loc, uint16_t op)
+{
+	struct sim_atu key = { .loc = *loc }, *a = NULL;
+	size_t lo = 0, hi = sim.natu, mid;
+	struct loc g1 = *loc;
+	struct sim_reg *r;
+	int err = 0, from, i;
+
+	if (!sim.atu_sorted) {
+		qsort(sim.atu, sim.natu, sizeof(*sim.atu), sim_atu_cmp);
+		sim.atu_sorted = 1;
+	}
+
+	g1.reg = ATU_FID;
+	r = sim_find(&g1);
+	key.fid = r ? r->val & ATU_FID_MAX : 0;
+
+	for (i = 0; i < 3; i++) {
+		g1.reg = ATU_MAC01 + i;
+		r = sim_find(&g1);
+		key.mac[2 * i]     = r ? r->val >> 8 : 0xff;
+		key.mac[2 * i + 1] = r ? r->val & 0xff : 0xff;
+	}
+
+	/* the broadcast address wraps around to the first entry */
+	from = memcmp(key.mac, "\xff\xff\xff\xff\xff\xff", 6) ? 1 : 0;
+	if (!from)
+		memset(key.mac, 0, sizeof(key.mac));
+
+	key.loc.reg = 0;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (sim_atu_cmp(&sim.atu[mid], &key) < from)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < sim.natu && (op & 0x7000) == ATU_OP_GET_NEXT) {
+		a = &sim.atu[lo];
+		memset(key.mac, 0xff, sizeof(key.mac));
+
+		/* past the last entry of the database */
+		if (sim_atu_cmp(a, &key) > 0)
+			a = NULL;
+	}
+
+	for (i = 0; !err && i < 3; i++) {
+		g1.reg = ATU_MAC01 + i;
+		err = sim_set(&g1, a ? (a->mac[2 * i] << 8) | a->mac[2 * i + 1]
+			      : 0xffff);
+	}
+
+	g1.reg = ATU_DATA;
+	err = err ? : sim_set(&g1, a ? a->data : 0);
+
+	sim.smi_done = mono_ns() + sim.smi;
+	return err ? : sim_set(loc, op);
+}
+
+static int sim_is_stats_op(const struct loc *loc)
+{
+	return loc_is_c45(loc) && loc_c45_dev(loc) == STATS_G1 &&
+		loc->reg == STATS_OP;
+}
+
+/* Run a stats op: a capture takes the counters of the port, either
+ * encoding of it, as they stand, and a read puts one of them in the
+ * counter registers. A counter overflowing carries into the next one,
+ * which is how the 64-bit octet counters are split. */
+static int sim_stats(const struct loc *loc, uint16_t op)
+{
+	uint64_t t = mono_ns() - sim.epoch, v;
+	struct loc g1 = *loc;
+	struct sim_stats *st;
+	int err = 0, port, i;
+	size_t n;
+
+	switch (op & STATS_OP_MASK) {
+	case STATS_OP_CAPTURE:
+		port = (op >> 5) & 0x1f;
+		port = port ? port - 1 : (op & 0x1f);
+
+		memset(sim.stats_cap, 0, sizeof(sim.stats_cap));
+		for (n = 0, st = sim.stats; n < sim.nstats; n++, st++) {
+			if (st->port != port ||
+			    loc_c45_port(&st->loc) != loc_c45_port(loc) ||
+			    strncmp(st->loc.ifnam, loc->ifnam, IFNAMSIZ))
+				continue;
+
+			for (i = 0; i < STATS_COUNTERS; i++) {
+				v = st->rate[i] * t / 1000000000;
+				sim.stats_cap[i] += v;
+				if (i + 1 < STATS_COUNTERS)
+					sim.stats_cap[i + 1] += v >> 32;
+			}
+			break;
+		}
+		break;
+	case STATS_OP_READ:
+		g1.reg = STATS_CTR_HI;
+		err = sim_set(&g1, sim.stats_cap[op & 0x1f] >> 16);
+		g1.reg = STATS_CTR_LO;
+		err = err ? : sim_set(&g1, sim.stats_cap[op & 0x1f] & 0xffff);
+		break;
+	}
+
+	sim.smi_done = mono_ns() + sim.smi;
+	return err ? : sim_set(loc, op);
+}
+
+static int sim_read(struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val)
+{
+	struct sim_reg *r;
+	struct loc key;
+
+	(void)ctx;
+
+	sim_delay();
+
+	if (!sim_find_if(loc->ifnam))
+		return -ENODEV;
+
+	/* nothing drives the bus, the pull-up wins */
+	if (!sim_mmd_key(loc, &key, 0))
+		sim_bus_key(loc, &key);
+	r = sim_find(&key);
+	*val = r ? r->val : 0xffff;
+
+	if (r && r->flap)
+		*val = sim_flap(r->flap, *val);
+
+	if (r && r->aneg)
+		*val = sim_aneg(r->aneg, *val);
+
+	if (r && (r->val & SMI_BUSY) &&
+	    (sim_is_smi_cmd(loc) || sim_is_atu_op(loc) ||
+	     sim_is_stats_op(loc)) &&
+	    mono_ns() >= sim.smi_done)
+		*val = r->val &= ~SMI_BUSY;
+
+	return 0;
+}
+
+static int sim_write(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val)
+{
+	struct loc key;
+
+	(void)ctx;
+
+	sim_delay();
+
+	if (!sim_find_if(loc->ifnam))
+		return -ENODEV;
+
+	if (sim_is_smi_cmd(loc) && (val & SMI_BUSY))
+		return sim_smi(loc, val);
+
+	if (sim_is_atu_op(loc) && (val & ATU_BUSY))
+		return sim_atu(loc, val);
+
+	if (sim_is_stats_op(loc) && (val & STATS_BUSY))
+		return sim_stats(loc, val);
+
+	if (!sim_mmd_key(loc, &key, 1))
+		sim_bus_key(loc, &key);
+	return sim_set(&key, sim_aneg_restart(&key, val));
+}
+
+static int sim_ifaces(int (*cb)(const char *ifnam, void *arg), void *arg)
+{
+	struct sim_if *i;
+	int err = 0;
+
+	for (i = sim.ifs; !err && i; i = i->next)
+		err = cb(i->ifnam, arg);
+
+	return err;
+}
+
+struct mdio_backend sim_backend = {
+	.name   = "sim",
+	.open   = sim_open,
+	.read   = sim_read,
+	.write  = sim_write,
+	.ifaces = sim_ifaces,
+};
+
+/* The same store without the default image, fed from captured files */
+struct mdio_backend replay_backend = {
+	.name   = "replay",
+	.open   = sim_replay_open,
+	.read   = sim_read,
+	.write  = sim_write,
+	.ifaces = sim_ifaces,
+};
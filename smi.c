@@ -0,0 +1,125 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* Give up on a unit that stays busy for this long */
+#define SMI_TIMEOUT 100000000ULL
+
+/* The Global2 registers of the switch that LOC's PHY sits behind */
+static void smi_g2(const struct loc *loc, struct loc *g2)
+{
+	memset(g2, 0, sizeof(*g2));
+	memcpy(g2->ifnam, loc->ifnam, IFNAMSIZ);
+	g2->phy_id = mdio_phy_id_c45(loc_c45_port(loc), SMI_G2);
+}
+
+struct smi_cmd {
+	struct mdio_ctx *ctx;
+	struct loc *g2;
+};
+
+static int smi_read_cmd(void *arg, uint16_t *val)
+{
+	struct smi_cmd *sc = arg;
+
+	return mdio_ctx_read(sc->ctx, sc->g2, val);
+}
+
+/* Every command is waited out before the next one is issued, so the
+ * unit is always idle when we get to it. The first poll is held off
+ * for as long as the unit usually takes. */
+static int smi_wait(struct mdio_ctx *ctx, struct loc *g2)
+{
+	struct poll p = {
+		.mask = SMI_BUSY,
+		.timeout = SMI_TIMEOUT,
+		.hold = &ctx->smi_hold,
+	};
+	struct smi_cmd sc = { .ctx = ctx, .g2 = g2 };
+
+	g2->reg = SMI_PHY_CMD;
+	return poll_wait(&p, smi_read_cmd, &sc, NULL);
+}
+
+static int smi_cmd(struct mdio_ctx *ctx, struct loc *g2, uint16_t op,
+		   const struct loc *loc)
+{
+	uint16_t cmd = SMI_BUSY | SMI_MODE22 | op |
+		(loc_c45_dev(loc) << 5) | (loc->reg & 0x1f);
+	int err;
+
+	g2->reg = SMI_PHY_CMD;
+	err = mdio_ctx_write(ctx, g2, cmd);
+	if (err)
+		return err;
+
+	return smi_wait(ctx, g2);
+}
+
+int smi_read(struct mdio_ctx *ctx, const struct loc *loc, uint16_t *val)
+{
+	struct loc g2;
+	int err;
+
+	smi_g2(loc, &g2);
+
+	err = smi_cmd(ctx, &g2, SMI_OP_READ, loc);
+	if (err)
+		return err;
+
+	g2.reg = SMI_PHY_DATA;
+	return mdio_ctx_read(ctx, &g2, val);
+}
+
+int smi_write(struct mdio_ctx *ctx, const struct loc *loc, uint16_t val)
+{
+	struct loc g2;
+	int err;
+
+	smi_g2(loc, &g2);
+
+	g2.reg = SMI_PHY_DATA;
+	err = mdio_ctx_write(ctx, &g2, val);
+	if (err)
+		return err;
+
+	return smi_cmd(ctx, &g2, SMI_OP_WRITE, loc);
+}
+
+/* Back to back commands, each one costing its command write, usually a
+ * single poll, and the data read. */
+int smi_read_range(struct mdio_ctx *ctx, const struct loc *loc,
+		   uint16_t *buf, int count)
+{
+	struct loc loc_reg = *loc;
+	int err, i;
+
+	for (i = 0; i < count; i++, loc_reg.reg++) {
+		err = smi_read(ctx, &loc_reg, &buf[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
@@ -0,0 +1,517 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* On-disk layout, all fields little-endian:
+ *
+ *   struct snap_hdr
+ *   struct snap_block[nblocks]
+ *   register values, each block's run starting 8-byte aligned
+ */
+#define SNAP_MAGIC   "PHYSNAP"
+#define SNAP_VERSION 1
+
+#define SNAP_F_MV6   0x1
+#define SNAP_F_PAGE  0x2	/* on the Marvell page in bits 15:8 */
+#define SNAP_F_MMD   0x4	/* C45 read through C22 registers 13/14 */
+
+#define SNAP_PAGE_SHIFT 8
+
+struct snap_hdr {
+	char     magic[8];
+	uint32_t version;
+	uint32_t nblocks;
+	uint64_t time;
+};
+
+struct snap_block {
+	char     ifnam[IFNAMSIZ];
+	uint16_t phy_id;
+	uint16_t reg;
+	uint32_t count;
+	uint32_t id;
+	uint32_t flags;
+	uint64_t offset;
+	char     model[16];
+};
+
+struct snap {
+	size_t size;
+	void *base;
+
+	const struct snap_hdr *hdr;
+	const struct snap_block *blocks;
+	uint32_t nblocks;
+};
+
+struct snap_save {
+	struct snap_block *blocks;
+	uint32_t nblocks;
+
+	uint16_t *vals;
+	size_t nvals;
+};
+
+static size_t snap_align(size_t nvals)
+{
+	return (nvals + 3) & ~3;
+}
+
+static int snap_add(struct snap_save *save, const struct loc *loc, int count,
+		    int mv6)
+{
+	struct snap_block *b;
+	struct loc loc_id = *loc;
+	uint16_t *vals, hi = 0, lo = 0;
+	size_t nvals = snap_align(count);
+	int err;
+
+	b = realloc(save->blocks, (save->nblocks + 1) * sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+	save->blocks = b;
+
+	vals = realloc(save->vals, (save->nvals + nvals) * sizeof(*vals));
+	if (!vals)
+		return -ENOMEM;
+	save->vals = vals;
+	vals = &save->vals[save->nvals];
+	memset(vals, 0, nvals * sizeof(*vals));
+
+	err = mdio_read_range(loc, vals, count);
+	if (err)
+		return err;
+
+	b = &save->blocks[save->nblocks];
+	memset(b, 0, sizeof(*b));
+	strncpy(b->ifnam, loc->ifnam, IFNAMSIZ - 1);
+	b->phy_id = loc->phy_id;
+	b->reg = loc->reg;
+	b->count = count;
+	b->offset = save->nvals * sizeof(*vals);
+
+	if (loc_is_paged(loc))
+		b->flags |= SNAP_F_PAGE | (loc->page << SNAP_PAGE_SHIFT);
+	if (loc_is_mmd(loc))
+		b->flags |= SNAP_F_MMD;
+
+	if (mv6) {
+		/* the switch ID lives in register 3 of port 0 */
+		b->flags |= SNAP_F_MV6;
+		loc_id.phy_id = mdio_phy_id_c45(loc_c45_port(loc), 0x10);
+		loc_id.reg = 3;
+		err = mdio_read(&loc_id, &lo);
+		if (err)
+			return err;
+
+		b->id = lo;
+		strncpy(b->model, mv6_model_str(lo), sizeof(b->model) - 1);
+	} else {
+		loc_id.reg = MII_PHYSID1;
+		err = mdio_read(&loc_id, &hi);
+		loc_id.reg = MII_PHYSID2;
+		err = err ? : mdio_read(&loc_id, &lo);
+		if (err)
+			return err;
+
+		b->id = (hi << 16) | lo;
+	}
+
+	save->nblocks++;
+	save->nvals += nvals;
+	return 0;
+}
+
+static int snap_write(struct snap_save *save, const char *path)
+{
+	struct snap_hdr hdr;
+	struct snap_block *b;
+	uint64_t offset;
+	uint32_t i;
+	size_t n;
+	FILE *fp;
+	int err = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+	hdr.version = htole32(SNAP_VERSION);
+	hdr.nblocks = htole32(save->nblocks);
+	hdr.time = htole64(time(NULL));
+
+	offset = sizeof(hdr) + save->nblocks * sizeof(*b);
+	for (i = 0; i < save->nblocks; i++) {
+		b = &save->blocks[i];
+		b->phy_id = htole16(b->phy_id);
+		b->reg    = htole16(b->reg);
+		b->count  = htole32(b->count);
+		b->id     = htole32(b->id);
+		b->flags  = htole32(b->flags);
+		b->offset = htole64(b->offset + offset);
+	}
+
+	for (n = 0; n < save->nvals; n++)
+		save->vals[n] = htole16(save->vals[n]);
+
+	fp = fopen(path, "w");
+	if (!fp)
+		return -errno;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(save->blocks, sizeof(*b), save->nblocks, fp) != save->nblocks ||
+	    fwrite(save->vals, sizeof(*save->vals), save->nvals, fp) != save->nvals)
+		err = -EIO;
+
+	if (fclose(fp) && !err)
+		err = -errno;
+
+	return err;
+}
+
+static int snap_save_loc(struct applet *a, struct snap_save *save, char *text)
+{
+	int mv6 = (a->print == print_mv6tool);
+	size_t len = strlen(text);
+	struct loc loc;
+	int count, dev, err;
+
+	/* LOCATION/all takes every port, serdes and global device of
+	 * the switch that LOCATION is on */
+	if (mv6 && len > 4 && !strcmp(&text[len - 4], "/all")) {
+		text[len - 4] = '\0';
+		if (a->parse_loc(text, &loc, 0) || !loc_is_c45(&loc))
+			return -EINVAL;
+
+		for (dev = 0xf, loc.reg = 0; dev <= 0x1d; dev++) {
+			loc.phy_id = mdio_phy_id_c45(loc_c45_port(&loc), dev);
+			err = snap_add(save, &loc, 32, 1);
+			if (err)
+				return err;
+		}
+
+		return 0;
+	}
+
+	if (parse_loc_range(a, text, &loc, &count, 0))
+		return -EINVAL;
+
+	if (loc.reg == REG_SUMMARY) {
+		loc.reg = 0;
+		count = 32;
+	}
+
+	return snap_add(save, &loc, count, mv6);
+}
+
+static int snap_map(const char *path, struct snap *snap)
+{
+	const struct snap_block *b;
+	uint64_t off, len, hdr_end;
+	struct stat st;
+	uint32_t i;
+	int fd, err = -EINVAL;
+
+	memset(snap, 0, sizeof(*snap));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*snap->hdr)) {
+		close(fd);
+		return -ENOEXEC;
+	}
+
+	snap->size = st.st_size;
+	snap->base = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (snap->base == MAP_FAILED)
+		return -errno;
+
+	snap->hdr = snap->base;
+	snap->blocks = (const void *)&snap->hdr[1];
+	snap->nblocks = le32toh(snap->hdr->nblocks);
+
+	if (memcmp(snap->hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC))) {
+		err = -ENOEXEC;
+		goto err;
+	}
+
+	if (le32toh(snap->hdr->version) != SNAP_VERSION ||
+	    snap->nblocks > (snap->size - sizeof(*snap->hdr)) / sizeof(*b))
+		goto err;
+
+	/* values must lie between the block table and the end of the
+	 * file, checked without anything that could wrap */
+	hdr_end = sizeof(*snap->hdr) + (uint64_t)snap->nblocks * sizeof(*b);
+
+	for (i = 0; i < snap->nblocks; i++) {
+		b = &snap->blocks[i];
+		off = le64toh(b->offset);
+		len = (uint64_t)le32toh(b->count) * 2;
+
+		if (off % 8 || len > 0x20000 || off < hdr_end ||
+		    off > snap->size || len > snap->size - off)
+			goto err;
+	}
+
+	return 0;
+err:
+	munmap(snap->base, snap->size);
+	return err;
+}
+
+static const uint16_t *snap_vals(const struct snap *snap,
+				 const struct snap_block *b)
+{
+	return (const void *)((const char *)snap->base + le64toh(b->offset));
+}
+
+static int snap_block_eq(const struct snap_block *a, const struct snap_block *b)
+{
+	return a->phy_id == b->phy_id && a->reg == b->reg &&
+		a->count == b->count && a->flags == b->flags &&
+		!strncmp(a->ifnam, b->ifnam, IFNAMSIZ);
+}
+
+static const struct snap_block *snap_find(const struct snap *snap,
+					  const struct snap_block *b,
+					  uint32_t hint)
+{
+	uint32_t i;
+
+	/* two captures of the same setup have the same block order */
+	if (hint < snap->nblocks && snap_block_eq(&snap->blocks[hint], b))
+		return &snap->blocks[hint];
+
+	for (i = 0; i < snap->nblocks; i++) {
+		if (snap_block_eq(&snap->blocks[i], b))
+			return &snap->blocks[i];
+	}
+
+	return NULL;
+}
+
+static void snap_block_loc(const struct snap_block *b, struct loc *loc)
+{
+	memset(loc, 0, sizeof(*loc));
+	strncpy(loc->ifnam, b->ifnam, IFNAMSIZ - 1);
+	loc->phy_id = le16toh(b->phy_id);
+	loc->reg = le16toh(b->reg);
+
+	if (le32toh(b->flags) & SNAP_F_PAGE) {
+		loc->page = le32toh(b->flags) >> SNAP_PAGE_SHIFT;
+		loc->flags = LOC_F_PAGE;
+	}
+
+	if (le32toh(b->flags) & SNAP_F_MMD)
+		loc->flags = LOC_F_MMD;
+}
+
+static void snap_block_heading(const struct snap_block *b, const char *prefix)
+{
+	struct loc loc;
+	char name[48];
+
+	snap_block_loc(b, &loc);
+	loc_str(&loc, name, sizeof(name));
+
+	printf("%s%s", prefix, name);
+	if (le32toh(b->flags) & SNAP_F_MV6)
+		printf(" model:%.*s\n", (int)sizeof(b->model), b->model);
+	else
+		printf(" id:0x%.8x\n", le32toh(b->id));
+}
+
+static void snap_diff_reg(const struct snap_block *b, int n,
+			  uint16_t old, uint16_t new)
+{
+	struct loc loc;
+
+	snap_block_loc(b, &loc);
+	loc.reg += n;
+
+	if (loc_is_paged(&loc))
+		printf("%*sreg:%u.0x%.2x 0x%.4x -> 0x%.4x\n", INDENT, "",
+		       loc.page, loc.reg, le16toh(old), le16toh(new));
+	else
+		printf("%*sreg:0x%.2x 0x%.4x -> 0x%.4x\n", INDENT, "",
+		       loc.reg, le16toh(old), le16toh(new));
+
+	if (le32toh(b->flags) & SNAP_F_MV6) {
+		print_mv6_reg(&loc, le16toh(old), 2 * INDENT);
+		print_mv6_reg(&loc, le16toh(new), 2 * INDENT);
+	} else {
+		print_phy_reg(&loc, le16toh(old), 2 * INDENT);
+		print_phy_reg(&loc, le16toh(new), 2 * INDENT);
+	}
+}
+
+/* Skip identical 64-byte runs with one compare, then narrow down to
+ * the changed words. */
+static void snap_diff_block(const struct snap *sa, const struct snap_block *a,
+			    const struct snap *sb, const struct snap_block *b)
+{
+	const uint16_t *va = snap_vals(sa, a), *vb = snap_vals(sb, b);
+	int count = le32toh(a->count), heading = 0, i, j, n;
+
+	for (i = 0; i < count; i += 32) {
+		n = (count - i < 32) ? count - i : 32;
+		if (!memcmp(&va[i], &vb[i], n * sizeof(*va)))
+			continue;
+
+		for (j = i; j < i + n; j++) {
+			if (va[j] == vb[j])
+				continue;
+
+			if (!heading++)
+				snap_block_heading(a, "");
+
+			snap_diff_reg(a, j, va[j], vb[j]);
+		}
+	}
+}
+
+static int snapshot_diff(const char *path_a, const char *path_b)
+{
+	const struct snap_block *b;
+	struct snap sa, sb;
+	uint32_t i;
+	int err;
+
+	err = snap_map(path_a, &sa);
+	if (err) {
+		fprintf(stderr, "error: %s: bad snapshot (%d)\n", path_a, err);
+		return err;
+	}
+
+	err = snap_map(path_b, &sb);
+	if (err) {
+		fprintf(stderr, "error: %s: bad snapshot (%d)\n", path_b, err);
+		munmap(sa.base, sa.size);
+		return err;
+	}
+
+	for (i = 0; i < sa.nblocks; i++) {
+		b = snap_find(&sb, &sa.blocks[i], i);
+		if (b)
+			snap_diff_block(&sa, &sa.blocks[i], &sb, b);
+		else
+			snap_block_heading(&sa.blocks[i], "only in a: ");
+	}
+
+	for (i = 0; i < sb.nblocks; i++) {
+		if (!snap_find(&sa, &sb.blocks[i], i))
+			snap_block_heading(&sb.blocks[i], "only in b: ");
+	}
+
+	munmap(sa.base, sa.size);
+	munmap(sb.base, sb.size);
+	return 0;
+}
+
+/* Load every captured register into the sim store, along with the ID
+ * registers that the printers look at, for replay. */
+int snapshot_load(const char *path)
+{
+	const struct snap_block *b;
+	const uint16_t *vals;
+	struct snap snap;
+	struct loc loc;
+	uint32_t i, j, id;
+	int err;
+
+	err = snap_map(path, &snap);
+	if (err)
+		return err;
+
+	for (i = 0; !err && i < snap.nblocks; i++) {
+		b = &snap.blocks[i];
+		id = le32toh(b->id);
+		snap_block_loc(b, &loc);
+
+		/* the IDs are on every page */
+		loc.page = 0;
+		loc.flags &= ~LOC_F_PAGE;
+
+		if (le32toh(b->flags) & SNAP_F_MV6) {
+			loc.phy_id = mdio_phy_id_c45(loc_c45_port(&loc), 0x10);
+			loc.reg = 3;
+			err = sim_set(&loc, id);
+		} else {
+			loc.reg = MII_PHYSID1;
+			err = sim_set(&loc, id >> 16);
+			loc.reg = MII_PHYSID2;
+			err = err ? : sim_set(&loc, id & 0xffff);
+		}
+
+		snap_block_loc(b, &loc);
+		vals = snap_vals(&snap, b);
+		for (j = 0; !err && j < le32toh(b->count); j++, loc.reg++)
+			err = sim_set(&loc, le16toh(vals[j]));
+	}
+
+	munmap(snap.base, snap.size);
+	return err;
+}
+
+static int snapshot_save(struct applet *a, const char *path, int argc,
+			 char **argv)
+{
+	struct snap_save save = { .blocks = NULL };
+	int err = 0;
+
+	for (; !err && argc; argc--, argv++) {
+		err = snap_save_loc(a, &save, argv[0]);
+		if (err)
+			fprintf(stderr, "error: %s: unable to capture (%d)\n",
+				argv[0], err);
+	}
+
+	if (!err)
+		err = snap_write(&save, path);
+
+	free(save.blocks);
+	free(save.vals);
+	return err;
+}
+
+int phytool_snapshot(struct applet *a, int argc, char **argv)
+{
+	if (argc >= 3 && !strcmp(argv[0], "save"))
+		return snapshot_save(a, argv[1], argc - 2, &argv[2]) ? 1 : 0;
+
+	if (argc == 3 && !strcmp(argv[0], "diff"))
+		return snapshot_diff(argv[1], argv[2]) ? 1 : 0;
+
+	return 1;
+}
@@ -0,0 +1,386 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/timerfd.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+/* Give up on a unit that stays busy for this long */
+#define STATS_TIMEOUT 100000000ULL
+
+#define STATS_PORTS_MAX 11
+
+struct stats_model {
+	uint16_t id;
+	int ports;
+
+	/* the capture op takes (port + 1) << 5 rather than the port,
+	 * and reads select the rx+tx histogram */
+	int port1;
+};
+
+static const struct stats_model stats_models[] = {
+	{ .id = 0x0950, .ports = 11 },
+	{ .id = 0x0990, .ports = 11 },
+	{ .id = 0x1a70, .ports = 10 },
+	{ .id = 0x3520, .ports = 7, .port1 = 1 },
+
+	{ .id = 0 }
+};
+
+/* Bank 0, by counter number. The octet counters are 64 bits wide,
+ * with the upper half in the following counter. */
+static const char *stats_names[STATS_COUNTERS] = {
+	[0x00] = "in_good_octets",
+	[0x02] = "in_bad_octets",
+	[0x03] = "out_fcs_error",
+	[0x04] = "in_unicast",
+	[0x05] = "deferred",
+	[0x06] = "in_broadcasts",
+	[0x07] = "in_multicasts",
+	[0x08] = "hist_64bytes",
+	[0x09] = "hist_65_127bytes",
+	[0x0a] = "hist_128_255bytes",
+	[0x0b] = "hist_256_511bytes",
+	[0x0c] = "hist_512_1023bytes",
+	[0x0d] = "hist_1024_max_bytes",
+	[0x0e] = "out_octets",
+	[0x10] = "out_unicast",
+	[0x11] = "excessive",
+	[0x12] = "out_multicasts",
+	[0x13] = "out_broadcasts",
+	[0x14] = "single",
+	[0x15] = "out_pause",
+	[0x16] = "in_pause",
+	[0x17] = "multiple",
+	[0x18] = "in_undersize",
+	[0x19] = "in_fragments",
+	[0x1a] = "in_oversize",
+	[0x1b] = "in_jabber",
+	[0x1c] = "in_rx_error",
+	[0x1d] = "in_fcs_error",
+	[0x1e] = "collisions",
+	[0x1f] = "late",
+};
+
+struct stats_port {
+	uint32_t vals[STATS_COUNTERS];
+	uint32_t last[STATS_COUNTERS];
+	uint64_t ts, last_ts;
+};
+
+struct stats {
+	struct loc g1;
+	const struct stats_model *model;
+	struct stats_port ports[STATS_PORTS_MAX];
+
+	uint64_t hold;
+	uint16_t regs[3];
+	int nregs;
+
+	uint64_t cycles;
+	uint64_t overruns;
+	uint64_t polls;
+	uint64_t busy_ns;
+	uint64_t max_ns;
+};
+
+static volatile sig_atomic_t stats_stop;
+
+static void stats_sig(int signo)
+{
+	(void)signo;
+	stats_stop = 1;
+}
+
+static int stats_model(struct stats *s)
+{
+	struct loc loc = s->g1;
+	uint16_t id;
+	int err;
+
+	loc.phy_id = mdio_phy_id_c45(loc_c45_port(&s->g1), 0x10);
+	loc.reg = 3;
+	err = mdio_read(&loc, &id);
+	if (err)
+		return err;
+
+	for (s->model = stats_models; s->model->id; s->model++) {
+		if (s->model->id == (id & 0xfff0))
+			return 0;
+	}
+
+	fprintf(stderr, "error: stats: %s not supported\n", mv6_model_str(id));
+	return -ENOTSUP;
+}
+
+/* The counter registers follow the op register, so polling busy can
+ * read the counter along with it */
+static int stats_read_op(void *arg, uint16_t *val)
+{
+	struct stats *s = arg;
+	int err;
+
+	err = mdio_read_range(&s->g1, s->regs, s->nregs);
+	*val = s->regs[0];
+	return err;
+}
+
+/* Run one op. A read costs the op and a single poll when the first
+ * one is held off for as long as the unit took before, as for the SMI
+ * unit. */
+static int stats_op(struct stats *s, uint16_t op, uint32_t *val)
+{
+	struct poll p = {
+		.mask = STATS_BUSY,
+		.timeout = STATS_TIMEOUT,
+		.hold = &s->hold,
+	};
+	int err;
+
+	s->g1.reg = STATS_OP;
+	err = mdio_write(&s->g1, STATS_BUSY | op);
+	if (err)
+		return err;
+
+	s->nregs = val ? 3 : 1;
+	err = poll_wait(&p, stats_read_op, s, NULL);
+	s->polls += p.polls;
+	if (err)
+		return err;
+
+	if (val)
+		*val = (s->regs[1] << 16) | s->regs[2];
+
+	return 0;
+}
+
+static int stats_port_read(struct stats *s, int port)
+{
+	struct stats_port *sp = &s->ports[port];
+	uint16_t hist = 0, capture = port;
+	int err, i;
+
+	if (s->model->port1) {
+		hist = STATS_HIST_RX_TX;
+		capture = (port + 1) << 5;
+	}
+
+	err = stats_op(s, STATS_OP_CAPTURE | STATS_HIST_RX_TX | capture, NULL);
+	if (err)
+		return err;
+
+	sp->last_ts = sp->ts;
+	sp->ts = mono_ns();
+	memcpy(sp->last, sp->vals, sizeof(sp->last));
+
+	for (i = 0; i < STATS_COUNTERS; i++) {
+		err = stats_op(s, STATS_OP_READ | hist | i, &sp->vals[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* octet counters take the next one as their upper half */
+static int stats_wide(int i)
+{
+	return i + 1 < STATS_COUNTERS && !stats_names[i + 1];
+}
+
+static uint64_t stats_val(const uint32_t *vals, int i)
+{
+	if (stats_wide(i))
+		return ((uint64_t)vals[i + 1] << 32) | vals[i];
+
+	return vals[i];
+}
+
+static void stats_report(struct stats *s, int port)
+{
+	struct stats_port *sp = &s->ports[port];
+	uint64_t total, delta, ns = sp->ts - sp->last_ts;
+	double rate;
+	int i;
+
+	for (i = 0; i < STATS_COUNTERS; i++) {
+		if (!stats_names[i])
+			continue;
+
+		total = stats_val(sp->vals, i);
+		delta = total - stats_val(sp->last, i);
+		if (!stats_wide(i))
+			delta = (uint32_t)delta;
+
+		if (!delta)
+			continue;
+
+		rate = delta * 1e9 / ns;
+
+		if (emit_fmt != EMIT_TEXT) {
+			emit_begin();
+			emit_uint("ts", sp->ts);
+			emit_uint("port", port);
+			emit_str("counter", stats_names[i]);
+			emit_uint("total", total);
+			emit_uint("delta", delta);
+			emit_uint("rate", rate + 0.5);
+			emit_end();
+			continue;
+		}
+
+		printf("[%llu.%.9llu] port:%-2d %-20s %20llu +%llu %.1f/s\n",
+		       (unsigned long long)(sp->ts / 1000000000),
+		       (unsigned long long)(sp->ts % 1000000000),
+		       port, stats_names[i], (unsigned long long)total,
+		       (unsigned long long)delta, rate);
+	}
+}
+
+static int stats_cycle(struct stats *s)
+{
+	uint64_t start = mono_ns(), ns;
+	int err, port;
+
+	for (port = 0; port < s->model->ports; port++) {
+		err = stats_port_read(s, port);
+		if (err) {
+			fprintf(stderr, "error: stats (%d)\n", err);
+			return err;
+		}
+
+		/* the first cycle only sets the baseline */
+		if (s->cycles)
+			stats_report(s, port);
+	}
+
+	fflush(stdout);
+
+	ns = mono_ns() - start;
+	s->busy_ns += ns;
+	if (ns > s->max_ns)
+		s->max_ns = ns;
+
+	s->cycles++;
+	return 0;
+}
+
+static void stats_summary(struct stats *s, uint64_t interval)
+{
+	if (!s->cycles)
+		return;
+
+	fprintf(stderr, "cycles:%llu overruns:%llu ports:%d polls/cycle:%llu "
+		"cycle-avg:%lluns cycle-max:%lluns duty:%.2f%%\n",
+		(unsigned long long)s->cycles,
+		(unsigned long long)s->overruns, s->model->ports,
+		(unsigned long long)(s->polls / s->cycles),
+		(unsigned long long)(s->busy_ns / s->cycles),
+		(unsigned long long)s->max_ns,
+		100.0 * s->busy_ns / ((double)s->cycles * interval));
+}
+
+int mv6tool_stats(struct applet *a, int argc, char **argv)
+{
+	struct stats s = { .model = NULL };
+	uint64_t interval = 1000000000, exp, limit = 0;
+	struct itimerspec its;
+	struct sigaction sa;
+	int err = 0, fd = -1;
+	ssize_t len;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-i") && argc > 1) {
+			if (parse_interval(argv[1], &interval))
+				return 1;
+		} else if (!strcmp(argv[0], "-n") && argc > 1) {
+			limit = strtoull(argv[1], NULL, 0);
+		} else {
+			return 1;
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (argc != 1)
+		return 1;
+
+	if (parse_switch_loc(a, argv[0], &s.g1, STATS_G1)) {
+		fprintf(stderr, "error: bad location format\n");
+		return 1;
+	}
+
+	err = stats_model(&s);
+	if (err)
+		return 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stats_sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0)
+		return 1;
+
+	its.it_interval.tv_sec  = interval / 1000000000;
+	its.it_interval.tv_nsec = interval % 1000000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL)) {
+		err = -errno;
+		goto out;
+	}
+
+	while (!stats_stop && (!limit || s.cycles < limit)) {
+		err = stats_cycle(&s);
+		if (err)
+			break;
+
+		if (limit && s.cycles == limit)
+			break;
+
+		do {
+			len = read(fd, &exp, sizeof(exp));
+		} while (len < 0 && errno == EINTR && !stats_stop);
+
+		if (stats_stop)
+			break;
+
+		if (len != sizeof(exp)) {
+			err = -errno;
+			break;
+		}
+
+		s.overruns += exp - 1;
+	}
+
+	stats_summary(&s, interval);
+out:
+	close(fd);
+	return err ? 1 : 0;
+}
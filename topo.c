@@ -0,0 +1,296 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <net/if.h>
+#include <linux/mdio.h>
+
+#include "phytool.h"
+
+#define TOPO_MAGIC "# phytool topology v1"
+
+/* Everything location parsing needs to know about one netdev. swid
+ * and port are -1 for interfaces that are not switch ports. */
+struct topo_if {
+	unsigned index;
+	char ifnam[IFNAMSIZ];
+	int swid;
+	int port;
+};
+
+/* Built once on first use, by whichever thread gets there first;
+ * pthread_once makes the others wait for it and see all of it. */
+static struct {
+	pthread_once_t once;
+	int err;
+	const char *cache;
+
+	struct topo_if *ifs;
+	int n;
+} topo = { .once = PTHREAD_ONCE_INIT };
+
+void topo_set_cache(const char *path)
+{
+	topo.cache = path;
+}
+
+static int sysfs_readu(const char *path, int *result)
+{
+	FILE *fp;
+	char line[24];
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -EIO;
+
+	if (!fgets(line, sizeof(line), fp)) {
+		fclose(fp);
+		return -EIO;
+	}
+
+	/* limit to base ten here, output is zero padded */
+	*result = strtol(line, NULL, 10);
+	fclose(fp);
+	return (*result >= 0) ? 0 : -EINVAL;
+}
+
+static void topo_sysfs(struct topo_if *ti)
+{
+	char path[64 + IFNAMSIZ];
+
+	ti->swid = ti->port = -1;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/phys_switch_id",
+		 ti->ifnam);
+	if (sysfs_readu(path, &ti->swid))
+		return;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/phys_port_id",
+		 ti->ifnam);
+	if (sysfs_readu(path, &ti->port))
+		ti->swid = -1;
+}
+
+/* The cache is only trusted if it describes exactly the interfaces
+ * that exist now, any netdev coming or going changes the ifindex set. */
+static int topo_load(const char *path, struct if_nameindex *ifs, int n)
+{
+	struct topo_if *ti;
+	char line[128], name[IFNAMSIZ + 1];
+	FILE *fp;
+	int i;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -errno;
+
+	topo.ifs = calloc(n, sizeof(*topo.ifs));
+	if (!topo.ifs) {
+		fclose(fp);
+		return -ENOMEM;
+	}
+
+	if (!fgets(line, sizeof(line), fp) || strncmp(line, TOPO_MAGIC, strlen(TOPO_MAGIC)))
+		goto stale;
+
+	for (i = 0; fgets(line, sizeof(line), fp); i++) {
+		if (i == n)
+			goto stale;
+
+		ti = &topo.ifs[i];
+		if (sscanf(line, "%u %16s %d %d", &ti->index, name,
+			   &ti->swid, &ti->port) != 4 ||
+		    ti->index != ifs[i].if_index ||
+		    strncmp(name, ifs[i].if_name, IFNAMSIZ))
+			goto stale;
+
+		strncpy(ti->ifnam, name, IFNAMSIZ - 1);
+	}
+
+	if (i != n)
+		goto stale;
+
+	fclose(fp);
+	topo.n = n;
+	return 0;
+
+stale:
+	fclose(fp);
+	free(topo.ifs);
+	topo.ifs = NULL;
+	return -ESTALE;
+}
+
+static void topo_save(const char *path)
+{
+	char *tmp;
+	FILE *fp;
+	int i;
+
+	if (asprintf(&tmp, "%s.tmp", path) == -1)
+		return;
+
+	fp = fopen(tmp, "w");
+	if (!fp)
+		goto out;
+
+	fprintf(fp, TOPO_MAGIC "\n");
+	for (i = 0; i < topo.n; i++)
+		fprintf(fp, "%u %s %d %d\n", topo.ifs[i].index,
+			topo.ifs[i].ifnam, topo.ifs[i].swid, topo.ifs[i].port);
+
+	/* readers see either the old or the new index, never half */
+	if (fclose(fp) || rename(tmp, path))
+		remove(tmp);
+out:
+	free(tmp);
+}
+
+static int topo_build(void)
+{
+	struct if_nameindex *ifs;
+	int i, n;
+
+	ifs = if_nameindex();
+	if (!ifs)
+		return -errno;
+
+	for (n = 0; ifs[n].if_index; n++);
+
+	if (topo.cache && !topo_load(topo.cache, ifs, n))
+		goto out;
+
+	topo.ifs = calloc(n, sizeof(*topo.ifs));
+	if (!topo.ifs) {
+		if_freenameindex(ifs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		topo.ifs[i].index = ifs[i].if_index;
+		strncpy(topo.ifs[i].ifnam, ifs[i].if_name, IFNAMSIZ - 1);
+		topo_sysfs(&topo.ifs[i]);
+	}
+
+	topo.n = n;
+	if (topo.cache)
+		topo_save(topo.cache);
+out:
+	if_freenameindex(ifs);
+	return 0;
+}
+
+static void topo_init(void)
+{
+	topo.err = topo_build();
+}
+
+static int topo_get(void)
+{
+	pthread_once(&topo.once, topo_init);
+	return topo.err;
+}
+
+/* The first interface, by name, belonging to switch swid carries the
+ * MDIO traffic for all of it. */
+int topo_switch_if(int swid, char *ifnam)
+{
+	struct topo_if *found = NULL;
+	int err, i;
+
+	err = topo_get();
+	if (err)
+		return err;
+
+	for (i = 0; i < topo.n; i++) {
+		if (topo.ifs[i].swid != swid)
+			continue;
+
+		if (!found || strncmp(topo.ifs[i].ifnam, found->ifnam, IFNAMSIZ) < 0)
+			found = &topo.ifs[i];
+	}
+
+	if (!found)
+		return -ENOENT;
+
+	strncpy(ifnam, found->ifnam, IFNAMSIZ - 1);
+	return 0;
+}
+
+int topo_if_port(const char *ifnam, int *swid, int *port)
+{
+	int err, i;
+
+	err = topo_get();
+	if (err)
+		return err;
+
+	for (i = 0; i < topo.n; i++) {
+		if (strncmp(topo.ifs[i].ifnam, ifnam, IFNAMSIZ))
+			continue;
+
+		if (topo.ifs[i].swid < 0)
+			return -ENOSYS;
+
+		*swid = topo.ifs[i].swid;
+		*port = topo.ifs[i].port;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/* Interfaces whose PHYs sit on the same MDIO bus, like the ports of a
+ * switch or MACs sharing one, get the same BUS: the bus of their PHY
+ * device, else their switch, else the interface itself. */
+void topo_if_bus(const char *ifnam, char *bus, size_t size)
+{
+	char path[64 + IFNAMSIZ], link[256], *name, *addr;
+	int swid, port;
+	ssize_t len;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/phydev", ifnam);
+	len = readlink(path, link, sizeof(link) - 1);
+	if (len > 0) {
+		link[len] = '\0';
+		name = strrchr(link, '/');
+		name = name ? name + 1 : link;
+
+		/* PHY devices are named BUS:ADDR */
+		addr = strrchr(name, ':');
+		if (addr) {
+			*addr = '\0';
+			snprintf(bus, size, "mdio:%s", name);
+			return;
+		}
+	}
+
+	if (!topo_if_port(ifnam, &swid, &port)) {
+		snprintf(bus, size, "switch:%d", swid);
+		return;
+	}
+
+	snprintf(bus, size, "%.*s", IFNAMSIZ, ifnam);
+}
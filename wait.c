@@ -0,0 +1,89 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+static int wait_read(void *arg, uint16_t *val)
+{
+	return mdio_read(arg, val);
+}
+
+int phytool_wait(struct applet *a, int argc, char **argv)
+{
+	struct poll p = { .timeout = 5000000000ULL };
+	unsigned long mask, match;
+	struct loc loc;
+	uint16_t val = 0;
+	char *end;
+	int err;
+
+	if (argc < 3 || argc > 4)
+		return 1;
+
+	if (a->parse_loc(argv[0], &loc, 1)) {
+		fprintf(stderr, "error: bad location format\n");
+		return 1;
+	}
+
+	mask = strtoul(argv[1], &end, 0);
+	if (*end || mask > 0xffff)
+		return 1;
+
+	match = strtoul(argv[2], &end, 0);
+	if (*end || match > 0xffff)
+		return 1;
+
+	if (argc > 3 && parse_interval(argv[3], &p.timeout))
+		return 1;
+
+	p.mask = mask;
+	p.match = match & mask;
+
+	err = poll_wait(&p, wait_read, &loc, &val);
+	if (err == -ETIMEDOUT) {
+		fprintf(stderr, "error: timed out after %.3fms, last 0x%.4x\n",
+			p.ns / 1e6, val);
+		return 1;
+	} else if (err) {
+		fprintf(stderr, "error: phy_read (%d)\n", err);
+		return 1;
+	}
+
+	if (emit_fmt == EMIT_TEXT) {
+		printf("0x%.4x after %.3fms, %u reads\n", val, p.ns / 1e6,
+		       p.polls);
+		return 0;
+	}
+
+	emit_begin();
+	emit_loc("loc", &loc);
+	if (loc_is_paged(&loc))
+		emit_uint("page", loc.page);
+	emit_uint("reg", loc.reg);
+	emit_uint("val", val);
+	emit_uint("ns", p.ns);
+	emit_uint("reads", p.polls);
+	emit_end();
+	return 0;
+}
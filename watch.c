@@ -0,0 +1,287 @@
+/* This file is part of phytool
+ *
+ * phytool is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * phytool is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with phytool.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/timerfd.h>
+
+#include <linux/mdio.h>
+#include <net/if.h>
+
+#include "phytool.h"
+
+struct watch_loc {
+	struct loc loc;
+	int count;
+
+	uint16_t *last;
+	uint16_t *vals;
+};
+
+struct watch {
+	struct watch_loc *locs;
+	int n;
+	int mv6;
+
+	uint64_t cycles;
+	uint64_t overruns;
+	uint64_t busy_ns;
+	uint64_t max_ns;
+	uint64_t xfers;
+};
+
+static volatile sig_atomic_t watch_stop;
+
+static void watch_sig(int signo)
+{
+	(void)signo;
+	watch_stop = 1;
+}
+
+/* INTERVAL is in seconds unless suffixed with ns, us or ms */
+int parse_interval(const char *text, uint64_t *ns)
+{
+	char *end;
+	double val;
+
+	val = strtod(text, &end);
+	if (end == text || val <= 0)
+		return -EINVAL;
+
+	if (!strcmp(end, "ns"))
+		*ns = val;
+	else if (!strcmp(end, "us"))
+		*ns = val * 1e3;
+	else if (!strcmp(end, "ms"))
+		*ns = val * 1e6;
+	else if (!*end || !strcmp(end, "s"))
+		*ns = val * 1e9;
+	else
+		return -EINVAL;
+
+	return *ns ? 0 : -EINVAL;
+}
+
+static int watch_add(struct applet *a, struct watch *w, char *text)
+{
+	struct watch_loc *wl;
+
+	wl = realloc(w->locs, (w->n + 1) * sizeof(*wl));
+	if (!wl)
+		return -ENOMEM;
+
+	w->locs = wl;
+	wl = &w->locs[w->n];
+
+	if (parse_loc_range(a, text, &wl->loc, &wl->count, 0))
+		return -EINVAL;
+
+	if (wl->loc.reg == REG_SUMMARY) {
+		wl->loc.reg = 0;
+		wl->count = 32;
+	}
+
+	wl->last = calloc(wl->count, sizeof(*wl->last));
+	wl->vals = calloc(wl->count, sizeof(*wl->vals));
+	if (!wl->last || !wl->vals) {
+		free(wl->last);
+		free(wl->vals);
+		return -ENOMEM;
+	}
+
+	w->n++;
+	return 0;
+}
+
+static void watch_report(struct watch *w, struct watch_loc *wl, int i,
+			 uint64_t ts)
+{
+	struct loc loc = wl->loc;
+	char name[48];
+
+	loc.reg += i;
+	loc_str(&loc, name, sizeof(name));
+
+	printf("[%llu.%.9llu] %s reg:0x%.2x 0x%.4x -> 0x%.4x\n",
+	       (unsigned long long)(ts / 1000000000),
+	       (unsigned long long)(ts % 1000000000),
+	       name, loc.reg, wl->last[i], wl->vals[i]);
+
+	if (w->mv6)
+		print_mv6_reg(&loc, wl->vals[i], INDENT);
+	else
+		print_phy_reg(&loc, wl->vals[i], INDENT);
+}
+
+static int watch_cycle(struct watch *w)
+{
+	struct watch_loc *wl;
+	uint64_t start, ts;
+	int changed = 0;
+	int err, i, j;
+
+	start = mono_ns();
+
+	for (i = 0; i < w->n; i++) {
+		wl = &w->locs[i];
+
+		err = mdio_read_range(&wl->loc, wl->vals, wl->count);
+		if (err) {
+			fprintf(stderr, "error: phy_read (%d)\n", err);
+			return err;
+		}
+	}
+
+	ts = mono_ns();
+
+	/* the first cycle only sets the baseline */
+	for (i = 0; w->cycles && i < w->n; i++) {
+		wl = &w->locs[i];
+
+		for (j = 0; j < wl->count; j++) {
+			if (wl->vals[j] == wl->last[j])
+				continue;
+
+			watch_report(w, wl, j, ts);
+			changed = 1;
+		}
+	}
+
+	for (i = 0; i < w->n; i++) {
+		wl = &w->locs[i];
+		memcpy(wl->last, wl->vals, wl->count * sizeof(*wl->vals));
+		w->xfers += wl->count;
+	}
+
+	if (changed)
+		fflush(stdout);
+
+	ts = mono_ns() - start;
+	w->busy_ns += ts;
+	if (ts > w->max_ns)
+		w->max_ns = ts;
+
+	w->cycles++;
+	return 0;
+}
+
+static void watch_summary(struct watch *w, uint64_t interval)
+{
+	if (!w->cycles)
+		return;
+
+	fprintf(stderr, "cycles:%llu overruns:%llu regs/cycle:%llu "
+		"cycle-avg:%lluns cycle-max:%lluns duty:%.2f%%\n",
+		(unsigned long long)w->cycles,
+		(unsigned long long)w->overruns,
+		(unsigned long long)(w->xfers / w->cycles),
+		(unsigned long long)(w->busy_ns / w->cycles),
+		(unsigned long long)w->max_ns,
+		100.0 * w->busy_ns / ((double)w->cycles * interval));
+}
+
+int phytool_watch(struct applet *a, int argc, char **argv)
+{
+	struct watch w = { .locs = NULL, .mv6 = (a->print == print_mv6tool) };
+	struct itimerspec its;
+	struct sigaction sa;
+	uint64_t interval = 1000000000, exp, limit = 0;
+	int err = 0, fd = -1, i;
+	ssize_t len;
+
+	while (argc && argv[0][0] == '-') {
+		if (!strcmp(argv[0], "-i") && argc > 1) {
+			if (parse_interval(argv[1], &interval))
+				return 1;
+		} else if (!strcmp(argv[0], "-n") && argc > 1) {
+			limit = strtoull(argv[1], NULL, 0);
+		} else {
+			return 1;
+		}
+
+		argc -= 2, argv += 2;
+	}
+
+	if (!argc)
+		return 1;
+
+	for (; argc; argc--, argv++) {
+		err = watch_add(a, &w, argv[0]);
+		if (err) {
+			fprintf(stderr, "error: bad location format\n");
+			goto out;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watch_sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	/* a periodic timer keeps the schedule, however long each
+	 * cycle takes, missed periods show up as overruns */
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	its.it_interval.tv_sec  = interval / 1000000000;
+	its.it_interval.tv_nsec = interval % 1000000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(fd, 0, &its, NULL)) {
+		err = -errno;
+		goto out;
+	}
+
+	while (!watch_stop && (!limit || w.cycles < limit)) {
+		err = watch_cycle(&w);
+		if (err)
+			break;
+
+		do {
+			len = read(fd, &exp, sizeof(exp));
+		} while (len < 0 && errno == EINTR && !watch_stop);
+
+		if (watch_stop)
+			break;
+
+		if (len != sizeof(exp)) {
+			err = -errno;
+			break;
+		}
+
+		w.overruns += exp - 1;
+	}
+
+	watch_summary(&w, interval);
+out:
+	if (fd >= 0)
+		close(fd);
+
+	for (i = 0; i < w.n; i++) {
+		free(w.locs[i].last);
+		free(w.locs[i].vals);
+	}
+	free(w.locs);
+	return err ? 1 : 0;
+}